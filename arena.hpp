@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for data that lives as long as its owner, such as the station names of a table.
+// Memory comes in chunks that are never moved or reused, so pointers into the arena stay valid until
+// it is destroyed, and everything is released together, one free per chunk.
+class Arena
+{
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    char *_next = nullptr;
+    std::size_t _left = 0;
+    std::size_t _chunkSize;
+    std::size_t _reserved = 0;
+
+public:
+    explicit Arena(std::size_t chunkSize = std::size_t{64} << 10) noexcept : _chunkSize{chunkSize}
+    {
+    }
+
+    // Uninitialized storage of size bytes aligned to alignment (a power of two)
+    inline auto allocate(std::size_t size, std::size_t alignment = 1) -> char *
+    {
+        auto padding = (alignment - reinterpret_cast<std::uintptr_t>(_next) % alignment) % alignment;
+        if (__builtin_expect(size + padding > _left, 0))
+        {
+            // Requests larger than a chunk get a chunk of their own
+            auto chunkSize = std::max(_chunkSize, size + alignment);
+            _chunks.push_back(std::unique_ptr<char[]>{new char[chunkSize]});
+            _next = _chunks.back().get();
+            _left = chunkSize;
+            _reserved += chunkSize;
+            padding = (alignment - reinterpret_cast<std::uintptr_t>(_next) % alignment) % alignment;
+        }
+
+        auto data = _next + padding;
+        _next += padding + size;
+        _left -= padding + size;
+        return data;
+    }
+
+    // Copies the text into the arena
+    inline auto copy(std::string_view text) -> std::string_view
+    {
+        auto data = allocate(text.size());
+        std::memcpy(data, text.data(), text.size());
+        return {data, text.size()};
+    }
+
+    // Bytes taken from the heap so far
+    constexpr auto reserved() const noexcept
+    {
+        return _reserved;
+    }
+};
@@ -0,0 +1,388 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// A program that aggregates measurements.txt in its working directory and prints the result
+struct Engine
+{
+    std::string name;
+    std::string executable;
+    std::vector<std::string> arguments;
+};
+
+struct Dataset
+{
+    std::uint64_t rows;
+    std::uint64_t stations;
+    std::string zipf;
+
+    auto name() const
+    {
+        return "rows-" + std::to_string(rows) + "-stations-" + std::to_string(stations) + "-zipf-" + zipf;
+    }
+};
+
+struct Options
+{
+    std::vector<std::uint64_t> rows{1'000'000, 10'000'000};
+    std::vector<std::uint64_t> stations{413, 10'000};
+    std::string zipf = "0";
+    std::uint64_t seed = 1;
+    int runs = 5;
+    bool cold = true;
+    fs::path binaries;
+    fs::path data = "bench-data";
+};
+
+// Runs the program in the directory with its stdout redirected to a file, returns the exit status
+auto execute(const fs::path &directory, const std::string &executable, const std::vector<std::string> &arguments, const fs::path &output) -> int
+{
+    auto pid = ::fork();
+    if (pid < 0)
+    {
+        throw std::system_error{errno, std::generic_category(), "fork"};
+    }
+
+    if (pid == 0)
+    {
+        auto fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ::dup2(fd, STDOUT_FILENO) < 0 || ::chdir(directory.c_str()) < 0)
+        {
+            ::_exit(127);
+        }
+
+        auto argv = std::vector<char *>{const_cast<char *>(executable.c_str())};
+        for (const auto &argument : arguments)
+        {
+            argv.push_back(const_cast<char *>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        ::execv(executable.c_str(), argv.data());
+        ::_exit(127);
+    }
+
+    int status;
+    while (::waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw std::system_error{errno, std::generic_category(), "waitpid"};
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Evicts the file from the page cache so the next run reads it from the device
+auto dropPageCache(const fs::path &file)
+{
+    auto fd = ::open(file.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        ::fdatasync(fd);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+auto readFile(const fs::path &file)
+{
+    auto stream = std::ifstream{file, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{}};
+}
+
+// Splits a result of the form {<station>=<min>/<mean>/<max>, ...} into its stations
+auto splitResult(const std::string &result)
+{
+    auto stations = std::vector<std::string_view>{};
+    auto text = std::string_view{result};
+    if (text.size() < 2 || text.front() != '{')
+    {
+        return stations;
+    }
+
+    text = text.substr(1, text.find_last_of('}') - 1);
+    for (std::size_t next; !text.empty(); text.remove_prefix(next == text.npos ? text.size() : next + 2))
+    {
+        next = text.find(", ");
+        stations.push_back(text.substr(0, next));
+    }
+    return stations;
+}
+
+// "yes" when the result is byte-identical to the reference. "ties" when it differs only in means that are
+// exactly 0.1 above the reference's: the engines round the exact mean half up in integer tenths, while the
+// baseline goes through doubles and can round an exact .x5 tie down, never up. "no" otherwise, including
+// a mean below the reference's, which only a rounding regression of the engine can produce.
+auto compare(const std::string &result, const std::string &reference) -> const char *
+{
+    if (result == reference)
+    {
+        return "yes";
+    }
+
+    auto stations = splitResult(result);
+    auto references = splitResult(reference);
+    if (stations.empty() || stations.size() != references.size())
+    {
+        return "no";
+    }
+
+    for (auto i = std::size_t{0}; i < stations.size(); i++)
+    {
+        // Everything but the mean must match: the name, the minimum and the maximum
+        auto station = stations[i];
+        auto expected = references[i];
+        if (station == expected)
+        {
+            continue;
+        }
+
+        auto mean = station.find('/', station.rfind('='));
+        auto expectedMean = expected.find('/', expected.rfind('='));
+        if (mean == station.npos || expectedMean == expected.npos ||
+            station.substr(0, mean) != expected.substr(0, expectedMean) ||
+            station.substr(station.rfind('/')) != expected.substr(expected.rfind('/')))
+        {
+            return "no";
+        }
+
+        // Compare in whole tenths, the means have exactly one decimal
+        auto tenths = std::llround(std::strtod(std::string{station.substr(mean + 1)}.c_str(), nullptr) * 10.0);
+        auto expectedTenths = std::llround(std::strtod(std::string{expected.substr(expectedMean + 1)}.c_str(), nullptr) * 10.0);
+        if (tenths != expectedTenths + 1)
+        {
+            return "no";
+        }
+    }
+    return "ties";
+}
+
+// Nearest-rank percentile of the sorted samples
+auto percentile(const std::vector<double> &sorted, double p)
+{
+    auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+// Generates the dataset once, later runs reuse it as long as the parameters match
+auto prepare(const Options &options, const Dataset &dataset) -> fs::path
+{
+    auto directory = fs::absolute(options.data / dataset.name());
+    auto marker = directory / ("seed-" + std::to_string(options.seed));
+    if (fs::exists(marker) && fs::exists(directory / "measurements.txt"))
+    {
+        return directory;
+    }
+
+    fs::create_directories(directory);
+    std::cerr << "Generating " << dataset.name() << std::endl;
+
+    auto status = execute(directory, fs::absolute(options.binaries / "create_measurements").string(),
+                          {"--seed=" + std::to_string(options.seed),
+                           "--stations=" + std::to_string(dataset.stations),
+                           "--zipf=" + dataset.zipf,
+                           std::to_string(dataset.rows)},
+                          directory / "create_measurements.log");
+    if (status != 0)
+    {
+        throw std::runtime_error{"create_measurements failed for " + dataset.name()};
+    }
+
+    std::ofstream{marker};
+    return directory;
+}
+
+template <typename T>
+auto parseList(std::string_view text, std::vector<T> &values)
+{
+    values.clear();
+    auto stream = std::istringstream{std::string{text}};
+    for (std::string item; std::getline(stream, item, ',');)
+    {
+        values.push_back(static_cast<T>(std::stoull(item)));
+    }
+    return !values.empty();
+}
+
+void usage()
+{
+    std::cerr << "Usage: benchmark_engines [--rows=<n,...>] [--stations=<n,...>] [--zipf=<s>] [--seed=<n>]\n"
+                 "                         [--runs=<n>] [--warm-only] [--binaries=<dir>] [--data=<dir>]"
+              << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    auto options = Options{};
+    options.binaries = fs::canonical("/proc/self/exe").parent_path();
+
+    try
+    {
+        for (auto i = 1; i < argc; i++)
+        {
+            auto arg = std::string_view{argv[i]};
+            auto valid = true;
+
+            if (arg.substr(0, 7) == "--rows=")
+            {
+                valid = parseList(arg.substr(7), options.rows);
+            }
+            else if (arg.substr(0, 11) == "--stations=")
+            {
+                valid = parseList(arg.substr(11), options.stations);
+            }
+            else if (arg.substr(0, 7) == "--zipf=")
+            {
+                options.zipf = std::string{arg.substr(7)};
+            }
+            else if (arg.substr(0, 7) == "--seed=")
+            {
+                options.seed = std::stoull(std::string{arg.substr(7)});
+            }
+            else if (arg.substr(0, 7) == "--runs=")
+            {
+                options.runs = std::stoi(std::string{arg.substr(7)});
+                valid = options.runs > 0;
+            }
+            else if (arg == "--warm-only")
+            {
+                options.cold = false;
+            }
+            else if (arg.substr(0, 11) == "--binaries=")
+            {
+                options.binaries = arg.substr(11);
+            }
+            else if (arg.substr(0, 7) == "--data=")
+            {
+                options.data = arg.substr(7);
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid)
+            {
+                usage();
+                return 1;
+            }
+        }
+    }
+    catch (std::exception &)
+    {
+        usage();
+        return 1;
+    }
+
+    auto binary = [&](const char *name)
+    {
+        return fs::absolute(options.binaries / name).string();
+    };
+
+    // The first engine is the reference, see compare() for what the other outputs must match.
+    // The mmap engine runs with the default per-thread tables, shared compares the shared table against it.
+    auto engines = std::vector<Engine>{
+        {"baseline", binary("calculate_average_baseline"), {}},
+        {"ifstream", binary("calculate_average"), {"--reader=ifstream"}},
+        {"mmap", binary("calculate_average"), {"--reader=mmap"}},
+        {"shared", binary("calculate_average"), {"--table=shared"}},
+    };
+
+    // One tab-separated row per dataset, engine and cache state
+    std::cout << "dataset\trows\tstations\tbytes\tengine\tcache\truns\tmedian_ms\tp95_ms\trows_per_s\tgb_per_s\tidentical\n";
+
+    auto allIdentical = true;
+    try
+    {
+        for (auto rows : options.rows)
+        {
+            for (auto stations : options.stations)
+            {
+                auto dataset = Dataset{rows, stations, options.zipf};
+                auto directory = fs::absolute(prepare(options, dataset));
+                auto input = directory / "measurements.txt";
+                auto bytes = fs::file_size(input);
+                auto reference = std::string{};
+
+                for (const auto &engine : engines)
+                {
+                    auto output = directory / (engine.name + ".out");
+
+                    for (auto cold : {false, true})
+                    {
+                        if (cold && !options.cold)
+                        {
+                            continue;
+                        }
+
+                        // The warm series starts with one untimed run that also fills the page cache
+                        if (!cold && execute(directory, engine.executable, engine.arguments, output) != 0)
+                        {
+                            throw std::runtime_error{engine.name + " failed on " + dataset.name()};
+                        }
+
+                        auto samples = std::vector<double>{};
+                        for (auto run = 0; run < options.runs; run++)
+                        {
+                            if (cold)
+                            {
+                                dropPageCache(input);
+                            }
+
+                            auto start = std::chrono::steady_clock::now();
+                            auto status = execute(directory, engine.executable, engine.arguments, output);
+                            auto end = std::chrono::steady_clock::now();
+                            if (status != 0)
+                            {
+                                throw std::runtime_error{engine.name + " failed on " + dataset.name()};
+                            }
+                            samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                        }
+                        std::sort(samples.begin(), samples.end());
+
+                        auto result = readFile(output);
+                        if (reference.empty())
+                        {
+                            reference = result;
+                        }
+                        auto identical = compare(result, reference);
+                        allIdentical = allIdentical && std::strcmp(identical, "no") != 0;
+
+                        auto median = percentile(samples, 50.0);
+                        std::cout << dataset.name() << '\t' << rows << '\t' << stations << '\t' << bytes << '\t'
+                                  << engine.name << '\t' << (cold ? "cold" : "warm") << '\t' << options.runs << '\t'
+                                  << std::fixed << std::setprecision(3) << median << '\t' << percentile(samples, 95.0) << '\t'
+                                  << std::setprecision(0) << static_cast<double>(rows) / (median / 1000.0) << '\t'
+                                  << std::setprecision(3) << static_cast<double>(bytes) / (median / 1000.0) / 1e9 << '\t'
+                                  << identical << std::endl;
+                    }
+                }
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return allIdentical ? 0 : 2;
+}
@@ -1,327 +1,2231 @@
 #include <iostream>
 #include <fstream>
-#include <unordered_map>
 #include <iomanip>
-#include <cmath>
+#include <limits>
 #include <chrono>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <array>
+#include <memory>
+#include <optional>
 #include <filesystem>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// Generated with gperf using the station names inside the create_measurements.cpp
-struct PerfectHash
-{
-    std::size_t operator()(const std::string &str) const noexcept
-    {
-        static std::uint16_t asso_values[] =
-            {
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 110, 1269, 1269, 1269, 1269, 1269, 1269, 0,
-                1269, 0, 1269, 1269, 1269, 0, 0, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 145, 10, 240, 65, 175,
-                33, 413, 320, 280, 30, 190, 325, 0, 340, 335,
-                170, 1269, 385, 105, 115, 40, 456, 190, 0, 340,
-                0, 1269, 1269, 1269, 1269, 1269, 1269, 0, 280, 280,
-                310, 15, 15, 250, 225, 5, 210, 35, 25, 90,
-                0, 30, 325, 5, 5, 20, 105, 200, 275, 315,
-                5, 260, 130, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 0, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 5, 325,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 20, 1269, 1269, 1269, 10, 1269,
-                1269, 1269, 1269, 1269, 1269, 5, 10, 0, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269, 1269,
-                1269, 1269, 1269, 1269, 1269, 1269};
-
-        auto len = str.length();
-        auto hval = len;
-
-        switch (hval)
-        {
-        default:
-            hval += asso_values[static_cast<std::uint8_t>(str[4])];
-        /*FALLTHROUGH*/
-        case 4:
-        case 3:
-            hval += asso_values[static_cast<std::uint8_t>(str[2])];
-        /*FALLTHROUGH*/
-        case 2:
-        case 1:
-            hval += asso_values[static_cast<std::uint8_t>(str[0])];
-            break;
-        }
-        return hval + asso_values[static_cast<std::uint8_t>(str[len - 1])];
-    }
+#include "measurements.hpp"
+#include "parser.hpp"
+#include "station_table.hpp"
+#include "mapped_file.hpp"
+#include "scan.hpp"
+#include "sketches.hpp"
+#include "perf_counters.hpp"
+
+#ifdef ONEBRC_IO_URING
+#include "uring.hpp"
+#endif
+
+enum class Reader
+{
+    Mapped,
+    Stream,
+    Uring
 };
 
-struct Measurements
+// Where the threads aggregate: a table each, merged afterwards, or one table shared by all of them.
+// The shared table saves the per-thread tables and their merge but pays atomic adds on every row, and
+// threads contend on the stations they all hit. It is opt-in until the shared and per-thread engines
+// of the benchmark target show where it wins.
+enum class Table
 {
-    using ValType = std::int32_t;
+    PerThread,
+    Shared
+};
+
+static constexpr auto chunkSize = 1 << 12;
+static constexpr auto defaultFileName = "measurements.txt";
+
+template <typename Map>
+auto processStream(const char *fileName, SegmentScheduler &scheduler, unsigned partition, Map &stations, ThreadStats &stats) noexcept
+{
+    auto threadStart = std::chrono::steady_clock::now();
+    auto file = std::ifstream{fileName, std::ios::binary};
+    auto parser = Parser{};
+    auto chunk = std::array<char, chunkSize>{};
+    auto first = std::uintmax_t{scheduler.first()};
+    auto last = std::uintmax_t{scheduler.last()};
 
-    inline auto record(ValType measurement) noexcept
+    // Moves an offset after the first '\n' at or after offset - 1
+    auto align = [&](std::uintmax_t offset)
     {
-        if (_count == 0)
+        if (offset <= first || offset >= last)
         {
-            _min = measurement;
-            _max = measurement;
-            _sum = measurement;
-            _count = 1;
+            return offset;
         }
-        else
+
+        file.seekg(offset - 1);
+        for (auto current = offset - 1; current < last; current += chunkSize)
+        {
+            auto size = std::min(static_cast<std::uintmax_t>(chunkSize), last - current);
+            file.read(chunk.data(), size);
+
+            auto newline = static_cast<const char *>(std::memchr(chunk.data(), '\n', size));
+            if (newline != nullptr)
+            {
+                return current + static_cast<std::uintmax_t>(newline - chunk.data()) + 1;
+            }
+        }
+        return last;
+    };
+
+    for (std::size_t segmentStart, segmentEnd; scheduler.next(segmentStart, segmentEnd, partition);)
+    {
+        auto alignStart = std::chrono::steady_clock::now();
+        auto partStart = align(segmentStart);
+        auto partEnd = align(segmentEnd);
+        stats.boundarySearch += std::chrono::steady_clock::now() - alignStart;
+        auto pending = std::size_t{0};
+
+        // Move file pointer to partStart
+        file.seekg(partStart);
+
+        // Read each line using the format: <station>;<measurement>\n
+        for (auto current = partStart; current < partEnd;)
         {
-            _min = std::min(_min, measurement);
-            _max = std::max(_max, measurement);
-            _sum += measurement;
-            _count++;
+            auto size = std::min(static_cast<std::uintmax_t>(chunkSize - pending), partEnd - current);
+            file.read(chunk.data() + pending, size);
+            current += size;
+
+            // Move the incomplete last line to the front of the chunk
+            auto chunkEnd = chunk.data() + pending + size;
+            auto rest = parser(chunk.data(), chunkEnd, stations);
+            pending = static_cast<std::size_t>(chunkEnd - rest);
+            std::memmove(chunk.data(), rest, pending);
         }
+
+        stats.bytes += partStart < partEnd ? partEnd - partStart : 0;
+        stats.segments++;
     }
+    stats.rows = parser.rows();
+    stats.elapsed = std::chrono::steady_clock::now() - threadStart;
+}
+
+#ifdef ONEBRC_IO_URING
 
-    inline auto roundToPositive(double n) const noexcept
+// Per-thread state of the io_uring reader: a ring and `depth` page-aligned buffers, each holding one
+// segment plus the slack needed to align it for O_DIRECT and to finish the line crossing its end
+class UringReader
+{
+    IoUring _ring{depth};
+    std::size_t _bufferSize;
+    char *_memory;
+
+public:
+    static constexpr auto alignment = std::size_t{4096};
+    static constexpr auto depth = 4u;
+
+    explicit UringReader(std::size_t segmentSize) : _bufferSize{segmentSize + 3 * alignment}
     {
-        // std::round(1) uses "round to zero" but Java's Math.round(1) uses "round to positive/round to infinity"
-        return std::floor(n + 0.5);
+        auto memory = ::mmap(nullptr, depth * _bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            throw std::system_error{errno, std::generic_category(), "mmap"};
+        }
+        _memory = static_cast<char *>(memory);
+
+        // Fixed buffers save the kernel from mapping the pages on every read, plain reads work without them
+        iovec buffers[depth];
+        for (auto i = 0u; i < depth; i++)
+        {
+            buffers[i] = {buffer(i), _bufferSize};
+        }
+        _ring.registerBuffers(buffers, depth);
     }
 
-    inline auto round(double n) const noexcept
+    UringReader(const UringReader &) = delete;
+    UringReader &operator=(const UringReader &) = delete;
+
+    ~UringReader()
     {
-        // Round to nearest tenths place
-        return roundToPositive(n * 10.0) / 10.0;
+        ::munmap(_memory, depth * _bufferSize);
     }
 
-    inline auto mean() const noexcept
+    inline auto ring() noexcept -> IoUring &
     {
-        return round(static_cast<double>(_sum) / 10.0 / _count);
+        return _ring;
     }
 
-    inline auto min() const noexcept
+    inline auto buffer(unsigned index) const noexcept -> char *
     {
-        return round(static_cast<double>(_min) / 10.0);
+        return _memory + index * _bufferSize;
     }
+};
+
+// Keeps `depth` segment reads in flight and parses whichever completes first, so the device works
+// while the thread parses. Reads cover [start - 1, end + one page) rounded out to pages, enough to
+// move both boundaries after their next '\n' like the other readers do.
+template <typename Map>
+auto processUring(int fd, std::uint64_t fileSize, UringReader &reader, SegmentScheduler &scheduler, unsigned partition, Map &stations, ThreadStats &stats) noexcept
+{
+    constexpr auto alignment = UringReader::alignment;
+
+    struct Read
+    {
+        std::size_t start, end, offset, length;
+    };
 
-    inline auto max() const noexcept
+    auto threadStart = std::chrono::steady_clock::now();
+    auto parser = Parser{};
+    auto first = scheduler.first();
+    auto last = scheduler.last();
+    auto reads = std::array<Read, UringReader::depth>{};
+    auto inFlight = 0u;
+
+    // Queues the next segment into the buffer, returns false once the input was handed out
+    auto submit = [&](unsigned index)
+    {
+        std::size_t start, end;
+        if (!scheduler.next(start, end, partition))
+        {
+            return false;
+        }
+
+        auto offset = (start > first ? start - 1 : start) / alignment * alignment;
+        auto length = (end + alignment - 1) / alignment * alignment + alignment - offset;
+        reads[index] = {start, end, offset, length};
+        reader.ring().read(fd, index, reader.buffer(index), static_cast<std::uint32_t>(length), offset, index);
+        inFlight++;
+        return true;
+    };
+
+    for (auto index = 0u; index < UringReader::depth && submit(index); index++)
     {
-        return round(static_cast<double>(_max) / 10.0);
     }
 
-    inline auto merge(const Measurements &measurements) noexcept
+    while (inFlight > 0)
     {
-        if (_count == 0)
+        auto index = std::uint64_t{0};
+        auto result = std::int32_t{0};
+        if (auto error = reader.ring().wait(index, result); error != 0)
         {
-            *this = measurements;
+            stats.error = error;
+            break;
         }
-        else
+        inFlight--;
+
+        // Finish a short or failed read synchronously, only the end of the file may be missing
+        const auto &read = reads[index];
+        auto buffer = reader.buffer(static_cast<unsigned>(index));
+        auto size = result < 0 ? std::size_t{0} : static_cast<std::size_t>(result);
+        while (size < read.length && read.offset + size < fileSize)
+        {
+            auto count = ::pread(fd, buffer + size, read.length - size, static_cast<off_t>(read.offset + size));
+            if (count <= 0)
+            {
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                stats.error = count < 0 ? errno : EIO;
+                break;
+            }
+            size += static_cast<std::size_t>(count);
+        }
+        if (stats.error != 0)
+        {
+            break;
+        }
+
+        // Moves an offset after the first '\n' at or after offset - 1
+        auto data = static_cast<const char *>(buffer);
+        auto dataEnd = data + std::min(size, last - read.offset);
+        auto align = [&](std::size_t offset)
+        {
+            if (offset <= first || offset >= last)
+            {
+                return std::min(data + (offset - read.offset), dataEnd);
+            }
+
+            auto from = data + (offset - 1 - read.offset);
+            auto newline = static_cast<const char *>(std::memchr(from, '\n', static_cast<std::size_t>(dataEnd - from)));
+            return newline != nullptr ? newline + 1 : dataEnd;
+        };
+
+        auto alignStart = std::chrono::steady_clock::now();
+        auto start = align(read.start);
+        auto end = align(read.end);
+        stats.boundarySearch += std::chrono::steady_clock::now() - alignStart;
+
+        if (start < end)
         {
-            _min = std::min(_min, measurements._min);
-            _max = std::max(_max, measurements._max);
-            _sum += measurements._sum;
-            _count += measurements._count;
+            parser(start, end, stations);
+            stats.bytes += static_cast<std::size_t>(end - start);
         }
+        stats.segments++;
+
+        submit(static_cast<unsigned>(index));
     }
 
-    friend auto operator<<(std::ostream &os, const Measurements &measurements) noexcept -> std::ostream &
+    // After an error, wait for the reads still in flight since the kernel writes their buffers until then
+    for (; inFlight > 0; inFlight--)
     {
-        return os << measurements.min() << '/'
-                  << measurements.mean() << '/'
-                  << measurements.max();
+        auto index = std::uint64_t{0};
+        auto result = std::int32_t{0};
+        if (reader.ring().wait(index, result) != 0)
+        {
+            break;
+        }
     }
+    stats.rows = parser.rows();
+    stats.elapsed = std::chrono::steady_clock::now() - threadStart;
+}
 
-private:
-    ValType _count = 0, _min = 0, _max = 0, _sum = 0;
-};
+#endif
 
-class Parser
+// Fixed set of equally sized buffers cycling between the input reader, which fills them with newline-aligned
+// blocks, and the parser threads, which drain them. A slow consumer stalls the reader instead of growing memory.
+class BlockRing
 {
-    enum ParserStatus
+public:
+    struct Block
     {
-        StationName,
-        Measurement,
-        PositiveMeasurement,
-        NegativeMeasurement
+        std::size_t index;
+        std::size_t size;
     };
 
-    std::string _station;
-    Measurements::ValType _measurement = 0;
-    ParserStatus _status = ParserStatus::StationName;
+private:
+    std::vector<std::vector<char>> _buffers;
+    std::size_t _capacity;
+    std::vector<std::size_t> _free;
+    std::deque<Block> _filled;
+    bool _closed = false;
+    std::mutex _mutex;
+    std::condition_variable _freed, _published;
 
 public:
-    template <typename InputIterator, typename Map>
-    auto operator()(InputIterator begin, InputIterator end, Map &stations) noexcept
+    // Every buffer has one spare byte for the '\n' appended to an unterminated last line
+    BlockRing(std::size_t count, std::size_t capacity)
+        : _buffers(count, std::vector<char>(capacity + 1)), _capacity{capacity}
     {
-        for (auto it = begin; it != end; it++)
+        for (auto i = std::size_t{0}; i < count; i++)
         {
-            char c = *it;
+            _free.push_back(i);
+        }
+    }
 
-            switch (_status)
-            {
-            case ParserStatus::StationName:
-            {
-                switch (c)
-                {
-                case ';':
-                    _status = ParserStatus::Measurement;
-                    break;
-                default:
-                    _station += c;
-                }
-            }
-            break;
-            case ParserStatus::Measurement:
+    constexpr auto capacity() const noexcept
+    {
+        return _capacity;
+    }
+
+    inline auto data(const Block &block) noexcept
+    {
+        return _buffers[block.index].data();
+    }
+
+    // Waits for an empty buffer
+    auto acquire() -> Block
+    {
+        auto lock = std::unique_lock{_mutex};
+        _freed.wait(lock, [this]
+                    { return !_free.empty(); });
+        auto index = _free.back();
+        _free.pop_back();
+        return {index, 0};
+    }
+
+    auto publish(const Block &block)
+    {
+        {
+            auto lock = std::lock_guard{_mutex};
+            _filled.push_back(block);
+        }
+        _published.notify_one();
+    }
+
+    // No more blocks will be published, the parsers stop once the filled ones are drained
+    auto close()
+    {
+        {
+            auto lock = std::lock_guard{_mutex};
+            _closed = true;
+        }
+        _published.notify_all();
+    }
+
+    // Waits for a filled block, returns false when the ring is closed and drained
+    auto next(Block &block)
+    {
+        auto lock = std::unique_lock{_mutex};
+        _published.wait(lock, [this]
+                        { return !_filled.empty() || _closed; });
+        if (_filled.empty())
+        {
+            return false;
+        }
+        block = _filled.front();
+        _filled.pop_front();
+        return true;
+    }
+
+    auto release(const Block &block)
+    {
+        {
+            auto lock = std::lock_guard{_mutex};
+            _free.push_back(block.index);
+        }
+        _freed.notify_one();
+    }
+};
+
+// Reads the stream into the ring until end of input, returns 0 or the errno of the failed read().
+// A block is published once it is full or the input has nothing more to read right now, so a slow live
+// feed is still parsed promptly. Each block ends after its last '\n', the partial line moves to the next one.
+auto readBlocks(int fd, BlockRing &ring) -> int
+{
+    auto error = 0;
+    auto block = ring.acquire();
+    for (;;)
+    {
+        auto count = ::read(fd, ring.data(block) + block.size, ring.capacity() - block.size);
+        if (count < 0)
+        {
+            if (errno == EINTR)
             {
-                switch (c)
-                {
-                case '-':
-                    _status = ParserStatus::NegativeMeasurement;
-                    _measurement = 0;
-                    break;
-                default:
-                    _status = ParserStatus::PositiveMeasurement;
-                    _measurement = static_cast<Measurements::ValType>(c - '0');
-                }
+                continue;
             }
+            error = errno;
             break;
-            case ParserStatus::PositiveMeasurement:
-            {
-                switch (c)
-                {
-                case '\n':
-                    _status = ParserStatus::StationName;
-                    stations[_station].record(_measurement);
-                    _station.clear();
-                    break;
-                case '.':
-                    break;
-                default:
-                    _measurement = _measurement * 10 + static_cast<Measurements::ValType>(c - '0');
-                }
-            }
+        }
+        if (count == 0)
+        {
             break;
-            case ParserStatus::NegativeMeasurement:
+        }
+        block.size += static_cast<std::size_t>(count);
+
+        auto input = pollfd{fd, POLLIN, 0};
+        if (block.size < ring.capacity() && ::poll(&input, 1, 0) > 0)
+        {
+            continue;
+        }
+
+        auto data = ring.data(block);
+        auto newline = static_cast<const char *>(::memrchr(data, '\n', block.size));
+        if (newline == nullptr)
+        {
+            if (block.size == ring.capacity())
             {
-                switch (c)
-                {
-                case '\n':
-                    _status = ParserStatus::StationName;
-                    stations[_station].record(_measurement);
-                    _station.clear();
-                    break;
-                case '.':
-                    break;
-                default:
-                    _measurement = _measurement * 10 - static_cast<Measurements::ValType>(c - '0');
-                }
-            }
+                error = EMSGSIZE;
+                break;
             }
+            continue;
         }
-    }
-};
 
-using MapType = std::unordered_map<std::string, Measurements, PerfectHash>;
+        auto next = ring.acquire();
+        auto lineEnd = static_cast<std::size_t>(newline - data) + 1;
+        next.size = block.size - lineEnd;
+        std::memcpy(ring.data(next), data + lineEnd, next.size);
+        block.size = lineEnd;
+        ring.publish(block);
+        block = next;
+    }
 
-static constexpr auto chunkSize = 1 << 12;
-static constexpr auto fileName = "measurements.txt";
+    if (error == 0 && block.size != 0)
+    {
+        if (ring.data(block)[block.size - 1] != '\n')
+        {
+            ring.data(block)[block.size++] = '\n';
+        }
+        ring.publish(block);
+    }
+    else
+    {
+        ring.release(block);
+    }
+    ring.close();
+    return error;
+}
 
-auto process(int index, int numberOfThreads, std::uintmax_t fileSize, MapType &stations) noexcept
+// Rows parsed by all threads so far. Wakes the reporter every time another `every` rows are done.
+class Progress
 {
-    // Compute the chunk start and size
-    auto partSize = (fileSize + numberOfThreads - 1) / numberOfThreads; // ceiling
-    auto partStart = partSize * index;
-    auto partEnd = std::min(partStart + partSize, fileSize);
+    std::atomic<std::uint64_t> _rows{0};
+    std::uint64_t _every;
+    bool _done = false;
+    std::mutex _mutex;
+    std::condition_variable _changed;
 
-    // Adjust the part start and end pointers
-    auto file = std::ifstream{fileName, std::ios::binary};
-    if (index + 1 < numberOfThreads)
+public:
+    explicit Progress(std::uint64_t every) noexcept : _every{every}
+    {
+    }
+
+    auto add(std::uint64_t rows)
     {
-        // Adjust partEnd to align after '\n' character
-        for (char c; file.seekg(partEnd - 1), file.read(&c, 1), c != '\n'; partEnd++)
+        auto before = _rows.fetch_add(rows, std::memory_order_relaxed);
+        if (_every != 0 && before / _every != (before + rows) / _every)
         {
+            auto lock = std::lock_guard{_mutex};
+            _changed.notify_one();
         }
     }
 
-    if (0 < index)
+    auto finish()
     {
-        // Adjust partStart to align after '\n' character
-        for (char c; file.seekg(partStart - 1), file.read(&c, 1), c != '\n'; partStart++)
         {
+            auto lock = std::lock_guard{_mutex};
+            _done = true;
         }
+        _changed.notify_one();
     }
 
-    // Read chunks of memory
-    auto parser = Parser{};
-    auto chunk = std::array<char, chunkSize>{};
+    // Waits until the next `every` rows are done or the interval elapsed, returns false once the input ended
+    template <typename Duration>
+    auto wait(std::uint64_t &reported, Duration interval)
+    {
+        auto lock = std::unique_lock{_mutex};
+        auto due = [&]
+        {
+            return _done || (_every != 0 && _rows.load(std::memory_order_relaxed) / _every != reported / _every);
+        };
+
+        if (interval != Duration::zero())
+        {
+            _changed.wait_for(lock, interval, due);
+        }
+        else
+        {
+            _changed.wait(lock, due);
+        }
 
-    // Move file pointer to partStart
-    file.seekg(partStart);
+        reported = _rows.load(std::memory_order_relaxed);
+        return !_done;
+    }
+};
 
-    // Read each line using the format: <station>;<measurement>\n
-    for (auto current = partStart; current < partEnd; current += chunkSize)
+// Parses the blocks of the ring into the thread's table. The table lock is held per block so that
+// the reporter can take a snapshot between two blocks without stopping the other threads.
+template <typename Map>
+auto processBlocks(BlockRing &ring, Map &stations, std::mutex &mutex, Progress &progress, ThreadStats &stats) noexcept
+{
+    auto threadStart = std::chrono::steady_clock::now();
+    auto parser = Parser{};
+    for (auto block = BlockRing::Block{}; ring.next(block);)
     {
-        auto size = std::min(static_cast<std::uintmax_t>(chunkSize), partEnd - current);
-        file.read(chunk.data(), size);
-        parser(chunk.cbegin(), chunk.cbegin() + size, stations);
+        auto rows = parser.rows();
+        {
+            auto lock = std::lock_guard{mutex};
+            auto data = ring.data(block);
+            parser(data, data + block.size, stations);
+        }
+        ring.release(block);
+        progress.add(parser.rows() - rows);
+
+        stats.bytes += block.size;
+        stats.segments++;
     }
+    stats.rows = parser.rows();
+    stats.elapsed = std::chrono::steady_clock::now() - threadStart;
 }
 
-int main()
+// Aggregate of an append-only input up to a line boundary, so that a rerun only parses the lines appended
+// since. The input is recognised by its device and inode plus a hash of the bytes just before the offset:
+// a replaced, truncated or rewritten file no longer matches and is rescanned from the start.
+struct Checkpoint
 {
-    auto stations = MapType{};
+    static constexpr char magic[8] = {'1', 'b', 'r', 'c', 'c', 'k', 'p', '1'};
 
-    // Read the file using threads
-    auto fileSize = std::filesystem::file_size(fileName);
-    auto threads = std::vector<std::thread>{};
-    auto numberOfThreads = static_cast<int>(std::thread::hardware_concurrency());
-    auto stationMaps = std::vector<MapType>{static_cast<std::size_t>(numberOfThreads)};
-    for (auto i = 0; i < numberOfThreads; i++)
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t fingerprint = 0;
+    std::vector<std::pair<std::string, MeasurementsState>> stations;
+
+    // Hashes the last 4 KiB (or fewer) before the offset
+    static auto fingerprintOf(int fd, std::uint64_t offset) -> std::uint64_t
     {
-        threads.push_back(std::thread{process, i, numberOfThreads, fileSize, std::ref(stationMaps.at(i))});
+        auto size = static_cast<std::size_t>(std::min<std::uint64_t>(offset, 4096));
+        auto buffer = std::vector<char>(size);
+        for (auto done = std::size_t{0}; done < size;)
+        {
+            auto count = ::pread(fd, buffer.data() + done, size - done, static_cast<off_t>(offset - size + done));
+            if (count <= 0)
+            {
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error{count < 0 ? errno : EIO, std::generic_category(), "pread"};
+            }
+            done += static_cast<std::size_t>(count);
+        }
+        return WordHash{}(std::string_view{buffer.data(), size}) ^ offset;
     }
 
-    // Wait for the threads to finish
-    for (auto &thread : threads)
+    // End of the last complete line among the first size bytes
+    static auto lineBoundary(int fd, std::uint64_t size) -> std::uint64_t
     {
-        thread.join();
+        auto chunk = std::array<char, chunkSize>{};
+        while (size > 0)
+        {
+            auto length = static_cast<std::size_t>(std::min<std::uint64_t>(size, chunkSize));
+            auto count = ::pread(fd, chunk.data(), length, static_cast<off_t>(size - length));
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error{errno, std::generic_category(), "pread"};
+            }
+
+            auto newline = static_cast<const char *>(::memrchr(chunk.data(), '\n', static_cast<std::size_t>(count)));
+            if (newline != nullptr)
+            {
+                return size - length + static_cast<std::uint64_t>(newline - chunk.data()) + 1;
+            }
+            size -= length;
+        }
+        return 0;
     }
 
-    // Merge stations
-    for (const auto &map : stationMaps)
+    // Returns false if the file does not exist, throws std::runtime_error if it is not a valid checkpoint
+    auto load(const char *path) -> bool
+    {
+        auto file = std::ifstream{path, std::ios::binary};
+        if (!file)
+        {
+            return false;
+        }
+
+        char header[sizeof(magic)];
+        auto count = std::uint64_t{0};
+        file.read(header, sizeof(header));
+        read(file, device);
+        read(file, inode);
+        read(file, offset);
+        read(file, fingerprint);
+        read(file, count);
+        if (!file || std::memcmp(header, magic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error{std::string{path} + ": not a checkpoint"};
+        }
+
+        stations.clear();
+        for (auto i = std::uint64_t{0}; i < count && file; i++)
+        {
+            auto length = std::uint16_t{0};
+            read(file, length);
+            auto &[name, state] = stations.emplace_back(std::string(length, '\0'), MeasurementsState{});
+            file.read(name.data(), length);
+            read(file, state.sum);
+            read(file, state.count);
+            read(file, state.min);
+            read(file, state.max);
+        }
+        if (!file)
+        {
+            throw std::runtime_error{std::string{path} + ": truncated checkpoint"};
+        }
+        return true;
+    }
+
+    // Writes a temporary file next to the checkpoint and renames it over, so a crash keeps the old one
+    auto save(const char *path) const
     {
-        for (const auto &[key, measurements] : map)
+        auto temporary = std::string{path} + ".tmp";
         {
-            stations[key].merge(measurements);
+            auto file = std::ofstream{temporary, std::ios::binary | std::ios::trunc};
+            file.write(magic, sizeof(magic));
+            write(file, device);
+            write(file, inode);
+            write(file, offset);
+            write(file, fingerprint);
+            write(file, static_cast<std::uint64_t>(stations.size()));
+            for (const auto &[name, state] : stations)
+            {
+                write(file, static_cast<std::uint16_t>(name.size()));
+                file.write(name.data(), static_cast<std::streamsize>(name.size()));
+                write(file, state.sum);
+                write(file, state.count);
+                write(file, state.min);
+                write(file, state.max);
+            }
+            if (!file.flush())
+            {
+                throw std::runtime_error{temporary + ": write failed"};
+            }
+        }
+
+        if (std::rename(temporary.c_str(), path) != 0)
+        {
+            throw std::system_error{errno, std::generic_category(), path};
         }
     }
 
-    // Copy and sort the station names
-    auto keys = std::vector<std::string>{};
-    for (const auto &pair : stations)
+private:
+    // Fields are stored in host byte order, a checkpoint is not meant to move between machines
+    template <typename T>
+    static auto read(std::istream &stream, T &value) -> void
     {
-        keys.push_back(pair.first);
+        stream.read(reinterpret_cast<char *>(&value), sizeof(value));
     }
-    std::sort(keys.begin(), keys.end());
 
-    // Print each station summary using the format: <station>=<min>/<mean>/<max>
-    std::cout << '{' << std::fixed << std::setprecision(1);
-    for (auto it = keys.cbegin(); it != keys.cend(); it++)
+    template <typename T>
+    static auto write(std::ostream &stream, const T &value) -> void
     {
-        const auto &key = *it;
-        std::cout << key << '=' << stations.at(key);
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+};
 
-        if (it + 1 != keys.cend())
+// Columnar layout written by --convert, in host byte order: a 64-byte header, fixed-size blocks of two
+// columns (station ids, then measurements in tenths, each padded to whole 64-byte lines), the footers
+// with the min/max/sum/count of every station present in each block, the block index and the station
+// dictionary (16-bit length and name, ids in order of first appearance).
+struct ColumnarHeader
+{
+    static constexpr char magicValue[8] = {'1', 'b', 'r', 'c', 'c', 'o', 'l', '1'};
+
+    char magic[8];
+    std::uint32_t blockRows;
+    std::uint32_t stations;
+    std::uint64_t rows;
+    std::uint64_t blocks;
+    std::uint64_t indexOffset;
+    std::uint64_t dictionaryOffset;
+    std::uint64_t dictionarySize;
+    std::uint64_t reserved;
+};
+
+struct ColumnarBlock
+{
+    std::uint64_t offset; // of the id column, the tenths column follows it
+    std::uint64_t footerOffset;
+    std::uint32_t rows;
+    std::uint32_t footerEntries;
+};
+
+struct ColumnarFooterEntry
+{
+    std::uint32_t station;
+    std::uint32_t count;
+    std::int64_t sum;
+    std::int16_t min;
+    std::int16_t max;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(ColumnarHeader) == 64, "the first block starts on a cache line");
+static_assert(sizeof(ColumnarFooterEntry) == 24 && sizeof(ColumnarBlock) == 24, "entries stay 8-byte aligned");
+
+static constexpr auto columnarBlockRows = std::uint32_t{1} << 16;
+
+// Bytes of a column of 16-bit values, padded so that the last 32 values can be loaded as a whole
+constexpr auto columnBytes(std::size_t rows) noexcept
+{
+    return (rows * sizeof(std::int16_t) + blockSize - 1) / blockSize * blockSize;
+}
+
+// Map for the Parser that appends every row to the current block instead of aggregating it.
+// Stations get 16-bit ids in order of first appearance, full blocks go straight to the output file.
+class ColumnarWriter
+{
+    struct StationId
+    {
+        std::uint32_t value = std::numeric_limits<std::uint32_t>::max();
+    };
+
+    struct Appender
+    {
+        ColumnarWriter *writer;
+        std::uint32_t id;
+
+        inline auto record(std::int32_t measurement) -> void
+        {
+            writer->append(id, measurement);
+        }
+    };
+
+    StationTable<WordHash, StationId> _ids;
+    std::vector<std::string> _names;
+    std::vector<std::uint16_t> _stations;
+    std::vector<std::int16_t> _tenths;
+    std::vector<ColumnarBlock> _blocks;
+    std::vector<ColumnarFooterEntry> _footers;
+    std::vector<ColumnarFooterEntry> _blockFooter;
+    std::uint64_t _rows = 0;
+    std::ofstream _file;
+    std::string _path;
+
+    // Writes the columns of the block and keeps its footer for the end of the file
+    auto flush()
+    {
+        auto rows = _stations.size();
+        auto block = ColumnarBlock{static_cast<std::uint64_t>(_file.tellp()), 0, static_cast<std::uint32_t>(rows), 0};
+        _stations.resize(columnBytes(rows) / sizeof(std::uint16_t));
+        _tenths.resize(columnBytes(rows) / sizeof(std::int16_t));
+        _file.write(reinterpret_cast<const char *>(_stations.data()), static_cast<std::streamsize>(columnBytes(rows)));
+        _file.write(reinterpret_cast<const char *>(_tenths.data()), static_cast<std::streamsize>(columnBytes(rows)));
+
+        _blockFooter.assign(_names.size(), ColumnarFooterEntry{0, 0, 0, std::numeric_limits<std::int16_t>::max(), std::numeric_limits<std::int16_t>::min(), 0});
+        for (auto i = std::size_t{0}; i < rows; i++)
+        {
+            auto &entry = _blockFooter[_stations[i]];
+            entry.count++;
+            entry.sum += _tenths[i];
+            entry.min = std::min(entry.min, _tenths[i]);
+            entry.max = std::max(entry.max, _tenths[i]);
+        }
+
+        block.footerOffset = _footers.size();
+        for (auto station = std::uint32_t{0}; station < _blockFooter.size(); station++)
         {
-            std::cout << ", ";
+            if (_blockFooter[station].count != 0)
+            {
+                _blockFooter[station].station = station;
+                _footers.push_back(_blockFooter[station]);
+                block.footerEntries++;
+            }
         }
+
+        _blocks.push_back(block);
+        _rows += rows;
+        _stations.clear();
+        _tenths.clear();
     }
-    std::cout << '}';
 
-    return 0;
-}
\ No newline at end of file
+    inline auto append(std::uint32_t id, std::int32_t measurement) -> void
+    {
+        _stations.push_back(static_cast<std::uint16_t>(id));
+        _tenths.push_back(static_cast<std::int16_t>(measurement));
+        if (_stations.size() == columnarBlockRows)
+        {
+            flush();
+        }
+    }
+
+public:
+    using hasher = WordHash;
+
+    explicit ColumnarWriter(const char *path) : _ids{1 << 10}, _file{path, std::ios::binary | std::ios::trunc}, _path{path}
+    {
+        if (!_file)
+        {
+            throw std::system_error{errno, std::generic_category(), path};
+        }
+
+        // The header is written last, once the offsets are known
+        auto header = ColumnarHeader{};
+        _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        _stations.reserve(columnarBlockRows);
+        _tenths.reserve(columnarBlockRows);
+    }
+
+    inline auto get(std::string_view name, std::uint64_t hash) -> Appender
+    {
+        auto &id = _ids.get(name, hash);
+        if (__builtin_expect(id.value == std::numeric_limits<std::uint32_t>::max(), 0))
+        {
+            if (_names.size() > std::numeric_limits<std::uint16_t>::max())
+            {
+                throw std::runtime_error{"more than 65536 stations do not fit the columnar format"};
+            }
+            id.value = static_cast<std::uint32_t>(_names.size());
+            _names.emplace_back(name.substr(0, maxStationLength));
+        }
+        return {this, id.value};
+    }
+
+    // Writes the last block, the footers, the block index, the dictionary and the header
+    auto finish()
+    {
+        if (!_stations.empty())
+        {
+            flush();
+        }
+
+        // Footer positions were collected as entry indexes, turn them into file offsets
+        auto footersOffset = static_cast<std::uint64_t>(_file.tellp());
+        for (auto &block : _blocks)
+        {
+            block.footerOffset = footersOffset + block.footerOffset * sizeof(ColumnarFooterEntry);
+        }
+        _file.write(reinterpret_cast<const char *>(_footers.data()), static_cast<std::streamsize>(_footers.size() * sizeof(ColumnarFooterEntry)));
+
+        auto header = ColumnarHeader{};
+        std::memcpy(header.magic, ColumnarHeader::magicValue, sizeof(header.magic));
+        header.blockRows = columnarBlockRows;
+        header.stations = static_cast<std::uint32_t>(_names.size());
+        header.rows = _rows;
+        header.blocks = _blocks.size();
+        header.indexOffset = static_cast<std::uint64_t>(_file.tellp());
+        _file.write(reinterpret_cast<const char *>(_blocks.data()), static_cast<std::streamsize>(_blocks.size() * sizeof(ColumnarBlock)));
+
+        header.dictionaryOffset = static_cast<std::uint64_t>(_file.tellp());
+        for (const auto &name : _names)
+        {
+            auto length = static_cast<std::uint16_t>(name.size());
+            _file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+            _file.write(name.data(), static_cast<std::streamsize>(name.size()));
+        }
+        header.dictionarySize = static_cast<std::uint64_t>(_file.tellp()) - header.dictionaryOffset;
+
+        _file.seekp(0);
+        _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (!_file.flush())
+        {
+            throw std::runtime_error{_path + ": write failed"};
+        }
+        return header;
+    }
+};
+
+// Read-only array inside a mapped file
+template <typename T>
+struct MappedRange
+{
+    const T *first;
+    const T *last;
+
+    constexpr auto begin() const noexcept
+    {
+        return first;
+    }
+
+    constexpr auto end() const noexcept
+    {
+        return last;
+    }
+
+    constexpr auto size() const noexcept
+    {
+        return static_cast<std::size_t>(last - first);
+    }
+
+    constexpr auto operator[](std::size_t i) const noexcept -> const T &
+    {
+        return first[i];
+    }
+};
+
+// Columnar file mapped read-only, with its offsets checked against the file size
+class ColumnarFile
+{
+    MappedFile _file;
+    const ColumnarHeader *_header;
+    std::vector<std::string_view> _names;
+
+    auto fits(std::uint64_t offset, std::uint64_t size) const noexcept
+    {
+        return offset <= _file.size() && size <= _file.size() - offset;
+    }
+
+public:
+    // The error for a file whose contents do not add up, thrown by the constructor and by readers
+    // that find a bad column value in a block
+    static auto corrupt(const char *path)
+    {
+        return std::runtime_error{std::string{path} + ": corrupt columnar file"};
+    }
+
+    // Whether the file starts with the columnar magic
+    static auto detect(const char *path)
+    {
+        char magic[sizeof(ColumnarHeader::magicValue)] = {};
+        auto file = std::ifstream{path, std::ios::binary};
+        return file.read(magic, sizeof(magic)) && std::memcmp(magic, ColumnarHeader::magicValue, sizeof(magic)) == 0;
+    }
+
+    explicit ColumnarFile(const char *path) : _file{path}, _header{reinterpret_cast<const ColumnarHeader *>(_file.data())}
+    {
+        if (_file.size() < sizeof(ColumnarHeader) ||
+            std::memcmp(_header->magic, ColumnarHeader::magicValue, sizeof(_header->magic)) != 0 ||
+            _header->blockRows == 0 || _header->blockRows > columnarBlockRows ||
+            _header->indexOffset % alignof(ColumnarBlock) != 0 || _header->blocks > _file.size() / sizeof(ColumnarBlock) ||
+            !fits(_header->indexOffset, _header->blocks * sizeof(ColumnarBlock)) ||
+            !fits(_header->dictionaryOffset, _header->dictionarySize))
+        {
+            throw corrupt(path);
+        }
+
+        auto p = _file.data() + _header->dictionaryOffset;
+        auto end = p + _header->dictionarySize;
+        for (auto i = std::uint32_t{0}; i < _header->stations; i++)
+        {
+            std::uint16_t length;
+            if (end - p < static_cast<std::ptrdiff_t>(sizeof(length)))
+            {
+                throw corrupt(path);
+            }
+            std::memcpy(&length, p, sizeof(length));
+            p += sizeof(length);
+            if (end - p < length)
+            {
+                throw corrupt(path);
+            }
+            _names.emplace_back(p, length);
+            p += length;
+        }
+
+        for (const auto &block : blocks())
+        {
+            if (block.rows > _header->blockRows || block.footerOffset % alignof(ColumnarFooterEntry) != 0 ||
+                !fits(block.offset, 2 * columnBytes(block.rows)) ||
+                !fits(block.footerOffset, std::uint64_t{block.footerEntries} * sizeof(ColumnarFooterEntry)))
+            {
+                throw corrupt(path);
+            }
+            for (const auto &entry : footer(block))
+            {
+                if (entry.station >= _header->stations)
+                {
+                    throw corrupt(path);
+                }
+            }
+        }
+    }
+
+    inline auto header() const noexcept -> const ColumnarHeader &
+    {
+        return *_header;
+    }
+
+    inline auto names() const noexcept -> const std::vector<std::string_view> &
+    {
+        return _names;
+    }
+
+    inline auto blocks() const noexcept -> MappedRange<ColumnarBlock>
+    {
+        auto begin = reinterpret_cast<const ColumnarBlock *>(_file.data() + _header->indexOffset);
+        return MappedRange<ColumnarBlock>{begin, begin + _header->blocks};
+    }
+
+    inline auto footer(const ColumnarBlock &block) const noexcept -> MappedRange<ColumnarFooterEntry>
+    {
+        auto begin = reinterpret_cast<const ColumnarFooterEntry *>(_file.data() + block.footerOffset);
+        return MappedRange<ColumnarFooterEntry>{begin, begin + block.footerEntries};
+    }
+
+    inline auto stations(const ColumnarBlock &block) const noexcept
+    {
+        return reinterpret_cast<const std::uint16_t *>(_file.data() + block.offset);
+    }
+
+    inline auto tenths(const ColumnarBlock &block) const noexcept
+    {
+        return reinterpret_cast<const std::int16_t *>(_file.data() + block.offset + columnBytes(block.rows));
+    }
+};
+
+#if defined(__AVX2__) && !defined(ONEBRC_SWAR)
+
+// Bit i is set if lo <= values[i] <= hi, for 32 values
+inline auto rangeMask(const std::int16_t *values, std::int16_t lo, std::int16_t hi) noexcept -> std::uint32_t
+{
+    auto low = _mm256_set1_epi16(lo);
+    auto high = _mm256_set1_epi16(hi);
+    auto outside = [&](const std::int16_t *p)
+    {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        return _mm256_or_si256(_mm256_cmpgt_epi16(low, v), _mm256_cmpgt_epi16(v, high));
+    };
+
+    // Packing works per 128-bit lane, the permute restores the order of the 32 byte masks
+    auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(outside(values), outside(values + 16)), 0xD8);
+    return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(packed));
+}
+
+#elif defined(__SSE2__) && !defined(ONEBRC_SWAR)
+
+inline auto rangeMask(const std::int16_t *values, std::int16_t lo, std::int16_t hi) noexcept -> std::uint32_t
+{
+    auto low = _mm_set1_epi16(lo);
+    auto high = _mm_set1_epi16(hi);
+    auto outside = [&](const std::int16_t *p)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        return _mm_or_si128(_mm_cmpgt_epi16(low, v), _mm_cmpgt_epi16(v, high));
+    };
+
+    auto mask = std::uint32_t{0};
+    for (auto i = 0; i < 32; i += 16)
+    {
+        auto packed = _mm_packs_epi16(outside(values + i), outside(values + i + 8));
+        mask |= static_cast<std::uint32_t>(_mm_movemask_epi8(packed)) << i;
+    }
+    return ~mask;
+}
+
+#else
+
+inline auto rangeMask(const std::int16_t *values, std::int16_t lo, std::int16_t hi) noexcept -> std::uint32_t
+{
+    auto mask = std::uint32_t{0};
+    for (auto i = 0; i < 32; i++)
+    {
+        mask |= static_cast<std::uint32_t>(values[i] >= lo && values[i] <= hi) << i;
+    }
+    return mask;
+}
+
+#endif
+
+// Adds the rows of one block whose measurement lies in [lo, hi] to the per-station totals. The footer
+// settles most stations without touching the columns: a station entirely inside the range is taken as
+// a whole, one entirely outside is skipped, and only rows of the stations straddling a bound are tested.
+// The id column is only read here, so its ids are checked here: returns false for an id past the
+// dictionary.
+template <typename Measurements>
+auto aggregateBlock(const ColumnarFile &file, const ColumnarBlock &block, std::int16_t lo, std::int16_t hi,
+                    std::vector<Measurements> &totals, std::vector<std::uint8_t> &straddling) noexcept -> bool
+{
+    auto valid = true;
+    auto scan = false;
+    for (const auto &entry : file.footer(block))
+    {
+        if (entry.min >= lo && entry.max <= hi)
+        {
+            totals[entry.station].merge(Measurements::fromState({entry.sum, entry.count, entry.min, entry.max}));
+        }
+        else if (entry.max >= lo && entry.min <= hi)
+        {
+            straddling[entry.station] = 1;
+            scan = true;
+        }
+    }
+
+    if (scan)
+    {
+        auto stations = file.stations(block);
+        auto tenths = file.tenths(block);
+        for (auto i = std::size_t{0}; i < block.rows; i += 32)
+        {
+            auto mask = rangeMask(tenths + i, lo, hi);
+            if (block.rows - i < 32)
+            {
+                mask &= (std::uint32_t{1} << (block.rows - i)) - 1;
+            }
+
+            for (; mask != 0; mask &= mask - 1)
+            {
+                auto row = i + static_cast<std::size_t>(__builtin_ctz(mask));
+                auto station = stations[row];
+                if (__builtin_expect(station >= straddling.size(), 0))
+                {
+                    valid = false;
+                }
+                else if (straddling[station])
+                {
+                    totals[station].record(tenths[row]);
+                }
+            }
+        }
+    }
+
+    for (const auto &entry : file.footer(block))
+    {
+        straddling[entry.station] = 0;
+    }
+    return valid;
+}
+
+struct Options
+{
+    Reader reader = Reader::Mapped;
+    std::size_t segmentSize = defaultSegmentSize;
+    bool printStats = false;
+    bool wide = false;
+    bool percentiles = false;
+    Table table = Table::PerThread;
+    std::size_t top = 0; // bounded-memory mode with the k most frequent stations when not 0
+    std::uint64_t reportRows = 0;
+    std::chrono::milliseconds reportInterval{0};
+    const char *checkpoint = nullptr;
+    const char *convert = nullptr;
+    bool rangeFilter = false;
+    std::int16_t rangeMin = -999;
+    std::int16_t rangeMax = 999;
+    unsigned threads = 0; // 0 uses every selected CPU
+    bool smt = true;
+    const char *fileName = defaultFileName;
+    std::vector<std::string> inputs; // files to aggregate together, set when there is more than one
+};
+
+// Loads the checkpoint of the input and sets [first, last) to the complete lines it does not cover yet,
+// returns the fingerprint of the input at last for the next checkpoint. A checkpoint of another file or
+// of different contents is dropped and the input is scanned from the start.
+auto resume(const Options &options, Checkpoint &checkpoint, std::uint64_t &first, std::uint64_t &last) -> std::uint64_t
+{
+    auto fd = ::open(options.fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::system_error{errno, std::generic_category(), options.fileName};
+    }
+
+    try
+    {
+        struct stat st;
+        if (::fstat(fd, &st) < 0)
+        {
+            throw std::system_error{errno, std::generic_category(), options.fileName};
+        }
+        auto size = static_cast<std::uint64_t>(st.st_size);
+
+        auto loaded = checkpoint.load(options.checkpoint);
+        if (loaded && (checkpoint.device != st.st_dev || checkpoint.inode != st.st_ino || checkpoint.offset > size ||
+                       Checkpoint::fingerprintOf(fd, checkpoint.offset) != checkpoint.fingerprint))
+        {
+            std::cerr << options.checkpoint << " does not match " << options.fileName << ", rescanning it" << std::endl;
+            loaded = false;
+        }
+        if (!loaded)
+        {
+            checkpoint.offset = 0;
+            checkpoint.stations.clear();
+        }
+
+        checkpoint.device = st.st_dev;
+        checkpoint.inode = st.st_ino;
+        first = checkpoint.offset;
+        last = std::max(first, Checkpoint::lineBoundary(fd, size));
+
+        auto fingerprint = Checkpoint::fingerprintOf(fd, last);
+        ::close(fd);
+        return fingerprint;
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+}
+
+// Prints where the time went to stderr: phases, threads, table probes and hardware counters per row
+auto reportStats(const std::vector<std::pair<const char *, std::chrono::steady_clock::duration>> &phases,
+                const std::vector<ThreadStats> &threadStats, const ProbeStats &probes, const char *tables,
+                const PerfCounters &counters)
+{
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    std::cerr << std::fixed << std::setprecision(3);
+
+    for (const auto &[phase, duration] : phases)
+    {
+        std::cerr << phase << ": " << Milliseconds(duration).count() << " ms\n";
+    }
+
+    for (auto i = std::size_t{0}; i < threadStats.size(); i++)
+    {
+        std::cerr << "thread " << i << ": " << threadStats[i].segments << " segments, "
+                  << threadStats[i].bytes << " bytes, " << threadStats[i].rows << " rows, "
+                  << Milliseconds(threadStats[i].elapsed).count() << " ms, "
+                  << Milliseconds(threadStats[i].boundarySearch).count() << " ms boundary search\n";
+    }
+
+    auto rows = static_cast<double>(std::max(std::uint64_t{1}, probes.rows));
+    std::cerr << "probes: " << probes.stations << ' ' << tables << " stations, " << probes.displaced << " displaced, "
+              << probes.maxProbes << " max, " << std::setprecision(4) << static_cast<double>(probes.probes) / rows
+              << " per row\n";
+
+    if (counters.error() != 0)
+    {
+        std::cerr << "perf counters unavailable: " << std::strerror(counters.error()) << '\n';
+        return;
+    }
+    for (auto event = 0; event < PerfCounters::EventCount; event++)
+    {
+        auto value = std::uint64_t{0};
+        std::cerr << PerfCounters::names[event] << ": ";
+        if (counters.read(static_cast<PerfCounters::Event>(event), value))
+        {
+            std::cerr << value << ", " << static_cast<double>(value) / rows << " per row\n";
+        }
+        else
+        {
+            std::cerr << "unavailable\n";
+        }
+    }
+}
+
+// Renders each station summary using the format: <station>=<min>/<mean>/<max> into one buffer and prints it
+// with as few write() calls as the kernel allows, returns false after reporting a failed write
+template <typename Map>
+auto writeResult(const Map &stations, const std::vector<std::string_view> &keys, bool newline) -> bool
+{
+    auto outputSize = std::size_t{3};
+    for (const auto &key : keys)
+    {
+        outputSize += key.size() + 1 + Map::mapped_type::maxFormattedLength + 2;
+    }
+
+    auto output = std::vector<char>(outputSize);
+    auto out = output.data();
+    *out++ = '{';
+    for (auto it = keys.cbegin(); it != keys.cend(); it++)
+    {
+        const auto &key = *it;
+        out = std::copy(key.cbegin(), key.cend(), out);
+        *out++ = '=';
+        out = stations.at(key).format(out);
+
+        if (it + 1 != keys.cend())
+        {
+            *out++ = ',';
+            *out++ = ' ';
+        }
+    }
+    *out++ = '}';
+    if (newline)
+    {
+        *out++ = '\n';
+    }
+
+    for (auto data = output.data(); data != out;)
+    {
+        auto written = ::write(STDOUT_FILENO, data, static_cast<std::size_t>(out - data));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << std::system_error{errno, std::generic_category(), "write"}.what() << std::endl;
+            return false;
+        }
+        data += written;
+    }
+    return true;
+}
+
+// Merges the thread tables after the scan together with the stations of a previous checkpoint,
+// prints the result and, with --stats, the report. After a scan into the shared table, stationMaps holds
+// a copy of it and sharedProbes its probe lengths.
+template <typename Map>
+auto finish(std::vector<Map> &stationMaps, const std::vector<ThreadStats> &threadStats,
+            std::optional<PerfCounters> &counters, std::chrono::steady_clock::duration scan,
+            const Checkpoint *checkpoint = nullptr, const std::optional<ProbeStats> &sharedProbes = std::nullopt) -> int
+{
+    using Clock = std::chrono::steady_clock;
+
+    // The probe lengths are derived from the thread-local tables before they are merged away
+    auto probes = ProbeStats{};
+    if (counters)
+    {
+        counters->disable();
+        if (sharedProbes)
+        {
+            probes = *sharedProbes;
+        }
+        else
+        {
+            for (const auto &stationMap : stationMaps)
+            {
+                probes.add(stationMap.probeStats());
+            }
+        }
+    }
+
+    // Merge stations
+    auto mergeStart = Clock::now();
+    mergeTables(stationMaps);
+    // Histograms cannot be restored from a checkpoint, main rejects the combination
+    if constexpr (!std::is_same_v<typename Map::mapped_type, HistogramMeasurements>)
+    {
+        if (checkpoint != nullptr)
+        {
+            for (const auto &[name, state] : checkpoint->stations)
+            {
+                stationMaps.front()[name].merge(Map::mapped_type::fromState(state));
+            }
+        }
+    }
+    const auto &stations = stationMaps.front();
+
+    auto sortStart = Clock::now();
+    auto keys = sortedKeys(stations);
+
+    auto outputStart = Clock::now();
+    if (!writeResult(stations, keys, false))
+    {
+        return 1;
+    }
+    auto outputEnd = Clock::now();
+
+    if (counters)
+    {
+        reportStats({{"scan", scan},
+                     {"merge", sortStart - mergeStart},
+                     {"sort", outputStart - sortStart},
+                     {"output", outputEnd - outputStart}},
+                    threadStats, probes, sharedProbes ? "shared" : "thread-local", *counters);
+    }
+
+    return 0;
+}
+
+// Slots of the shared table for a scan of the inputs, sized from a sample of their stations, or 0 to
+// scan with per-thread tables
+template <typename Map>
+auto sharedCapacity(const Options &options, const std::vector<std::string_view> &inputs) -> std::size_t
+{
+    if (std::is_same_v<typename Map::mapped_type, HistogramMeasurements> || options.table != Table::Shared)
+    {
+        return 0;
+    }
+    return std::max(std::size_t{1} << 14, 4 * sampleStations(inputs));
+}
+
+// Runs scan(thread, stations, stats) with one shared table when capacity is not 0, and with per-thread
+// tables otherwise or once the shared table turned out too small. sharedProbes receives the probe
+// lengths of a completed shared scan if it is given (--stats).
+template <typename Map, typename Scan>
+auto scanTables(const ThreadPlacement &placement, std::size_t capacity, SegmentScheduler &scheduler,
+                std::vector<ThreadStats> &threadStats, std::optional<ProbeStats> *sharedProbes, Scan scan) -> std::vector<Map>
+{
+    if constexpr (!std::is_same_v<typename Map::mapped_type, HistogramMeasurements>)
+    {
+        if (capacity != 0)
+        {
+            auto probes = ProbeStats{};
+            if (auto stationMaps = runShared<Map>(placement, threadStats, scan, capacity, sharedProbes != nullptr ? &probes : nullptr))
+            {
+                if (sharedProbes != nullptr)
+                {
+                    sharedProbes->emplace(probes);
+                }
+                return std::move(*stationMaps);
+            }
+
+            std::cerr << "More stations than the shared table holds, rescanning with per-thread tables" << std::endl;
+            scheduler.rewind();
+            threadStats.assign(threadStats.size(), ThreadStats{});
+        }
+    }
+    return runPlaced<Map>(placement, threadStats, scan);
+}
+
+#ifdef ONEBRC_IO_URING
+// Scans [first, last) of the file with the io_uring readers, returns false before reading anything
+// if the kernel refuses io_uring so that the caller falls back to the mmap reader
+template <typename Map>
+auto scanUring(const Options &options, const ThreadPlacement &placement, std::uint64_t first, std::uint64_t last, std::vector<Map> &stationMaps, std::vector<ThreadStats> &threadStats) -> bool
+{
+    // Probe once here, the readers themselves are built by their threads on their own node
+    try
+    {
+        IoUring{1};
+    }
+    catch (std::system_error &e)
+    {
+        std::cerr << e.what() << ", using the mmap reader" << std::endl;
+        return false;
+    }
+
+    // Bypass the page cache where the file system supports it, cold reads then go straight to the device
+    auto fd = ::open(options.fileName, O_RDONLY | O_DIRECT);
+    if (fd < 0)
+    {
+        fd = ::open(options.fileName, O_RDONLY);
+    }
+
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) < 0)
+    {
+        auto error = errno;
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        throw std::system_error{error, std::generic_category(), options.fileName};
+    }
+
+    auto fileSize = static_cast<std::uint64_t>(st.st_size);
+    auto scheduler = SegmentScheduler{first, std::min(last, fileSize), options.segmentSize, placement.nodeThreads()};
+    stationMaps = runPlaced<Map>(placement, threadStats, [&](unsigned i, Map &stations, ThreadStats &stats)
+                                 {
+                                     try
+                                     {
+                                         auto reader = UringReader{options.segmentSize};
+                                         processUring(fd, fileSize, reader, scheduler, placement.node(i), stations, stats);
+                                     }
+                                     catch (std::system_error &e)
+                                     {
+                                         stats.error = e.code().value();
+                                     } });
+
+    ::close(fd);
+    return true;
+}
+#endif
+
+template <typename Measurements>
+auto run(const Options &options) -> int
+{
+    using Map = MapType<Measurements>;
+    using Clock = std::chrono::steady_clock;
+
+    // Read the file using threads, spread over the NUMA nodes
+    auto placement = ThreadPlacement{options.threads, options.smt};
+    auto stationMaps = std::vector<Map>{};
+    auto threadStats = std::vector<ThreadStats>{placement.threads()};
+
+    // The counters are inherited by the threads started after they are enabled
+    auto counters = std::optional<PerfCounters>{};
+    if (options.printStats)
+    {
+        counters.emplace();
+        counters->enable();
+    }
+
+    // With a checkpoint only the complete lines appended since the previous run are parsed
+    auto checkpoint = Checkpoint{};
+    auto first = std::uint64_t{0};
+    auto last = std::numeric_limits<std::uint64_t>::max();
+    auto fingerprint = std::uint64_t{0};
+    if (options.checkpoint != nullptr)
+    {
+        try
+        {
+            fingerprint = resume(options, checkpoint, first, last);
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    auto sharedProbes = std::optional<ProbeStats>{};
+    auto scanStart = Clock::now();
+    try
+    {
+        auto reader = options.reader;
+
+#ifdef ONEBRC_IO_URING
+        if (reader == Reader::Uring && !scanUring(options, placement, first, last, stationMaps, threadStats))
+        {
+            reader = Reader::Mapped;
+        }
+#else
+        if (reader == Reader::Uring)
+        {
+            std::cerr << "Built without io_uring, using the mmap reader" << std::endl;
+            reader = Reader::Mapped;
+        }
+#endif
+
+        if (reader == Reader::Mapped)
+        {
+            // Each node's threads start on their own share of the file, so its pages are faulted in on that node
+            auto file = MappedFile{options.fileName};
+            auto scheduler = SegmentScheduler{first, std::min(last, std::uint64_t{file.size()}), options.segmentSize, placement.nodeThreads()};
+            auto range = std::string_view{file.data() + scheduler.first(), scheduler.last() - scheduler.first()};
+            stationMaps = scanTables<Map>(placement, sharedCapacity<Map>(options, {range}), scheduler, threadStats,
+                                          counters ? &sharedProbes : nullptr, [&](unsigned i, auto &stations, ThreadStats &stats)
+                                          { processMapped(file.data(), scheduler, placement.node(i), stations, stats); });
+        }
+        else if (reader == Reader::Stream)
+        {
+            auto fileSize = std::uint64_t{std::filesystem::file_size(options.fileName)};
+            auto scheduler = SegmentScheduler{first, std::min(last, fileSize), options.segmentSize, placement.nodeThreads()};
+            stationMaps = runPlaced<Map>(placement, threadStats, [&](unsigned i, Map &stations, ThreadStats &stats)
+                                         { processStream(options.fileName, scheduler, placement.node(i), stations, stats); });
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    auto scan = Clock::now() - scanStart;
+
+    for (const auto &stats : threadStats)
+    {
+        if (stats.error != 0)
+        {
+            std::cerr << std::system_error{stats.error, std::generic_category(), "read"}.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.checkpoint == nullptr)
+    {
+        return finish(stationMaps, threadStats, counters, scan, nullptr, sharedProbes);
+    }
+
+    // Fold the stored aggregate in, then store the new one once the result is out
+    auto status = finish(stationMaps, threadStats, counters, scan, &checkpoint, sharedProbes);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    checkpoint.offset = last;
+    checkpoint.fingerprint = fingerprint;
+    checkpoint.stations.clear();
+    for (const auto &[name, measurements] : stationMaps.front())
+    {
+        checkpoint.stations.emplace_back(name, measurements.state());
+    }
+
+    try
+    {
+        checkpoint.save(options.checkpoint);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Maps every file and returns their contents
+auto mapInputs(const std::vector<std::string> &fileNames, std::deque<MappedFile> &files) -> std::vector<std::string_view>
+{
+    auto inputs = std::vector<std::string_view>{};
+    for (const auto &fileName : fileNames)
+    {
+        const auto &file = files.emplace_back(fileName.c_str());
+        inputs.emplace_back(file.data(), file.size());
+    }
+    return inputs;
+}
+
+// Aggregates several files into one result. All inputs are mapped up front and split into segments that
+// the threads take from one shared cursor, so small files cost a segment each instead of a thread start.
+template <typename Measurements>
+auto runInputs(const Options &options) -> int
+{
+    using Map = MapType<Measurements>;
+    using Clock = std::chrono::steady_clock;
+
+    auto placement = ThreadPlacement{options.threads, options.smt};
+    auto stationMaps = std::vector<Map>{};
+    auto threadStats = std::vector<ThreadStats>{placement.threads()};
+
+    auto counters = std::optional<PerfCounters>{};
+    if (options.printStats)
+    {
+        counters.emplace();
+        counters->enable();
+    }
+
+    auto sharedProbes = std::optional<ProbeStats>{};
+    auto scanStart = Clock::now();
+    try
+    {
+        auto files = std::deque<MappedFile>{};
+        auto inputs = mapInputs(options.inputs, files);
+        auto segments = splitInputs(inputs, options.segmentSize);
+        auto scheduler = SegmentScheduler{0, segments.size(), 1, placement.nodeThreads()};
+        stationMaps = scanTables<Map>(placement, sharedCapacity<Map>(options, inputs), scheduler, threadStats,
+                                      counters ? &sharedProbes : nullptr, [&](unsigned i, auto &stations, ThreadStats &stats)
+                                      { processInputs(inputs, segments, scheduler, placement.node(i), stations, stats); });
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return finish(stationMaps, threadStats, counters, Clock::now() - scanStart, nullptr, sharedProbes);
+}
+
+// Bounded-memory aggregation for inputs with any number of stations (--top=<k>). The first pass feeds
+// fixed-size sketches: space-saving heavy hitters, a count-min sketch and a HyperLogLog. The second pass
+// aggregates the 2k stations they rank highest exactly, and every other row goes to one tail aggregate.
+// The k candidates with the most rows are printed like the full result, followed by a line on the tail.
+template <typename Measurements>
+auto runTop(const Options &options, const std::vector<std::string> &fileNames) -> int
+{
+    using Sketch = StationSketch<WordHash>;
+    using Candidates = CandidateTable<WordHash, Measurements>;
+
+    auto placement = ThreadPlacement{options.threads, options.smt};
+    auto threadStats = std::vector<ThreadStats>{placement.threads()};
+
+    try
+    {
+        auto files = std::deque<MappedFile>{};
+        auto inputs = mapInputs(fileNames, files);
+        auto segments = splitInputs(inputs, options.segmentSize);
+
+        // Any station with more than 1 / capacity of the rows is certain to be among the heavy hitters
+        auto names = std::vector<std::string>{};
+        auto distinct = 0.0;
+        {
+            auto scheduler = SegmentScheduler{0, segments.size(), 1, placement.nodeThreads()};
+            auto sketches = runPlaced<Sketch>(placement, threadStats, [&](unsigned i, Sketch &sketch, ThreadStats &stats)
+                                              { processInputs(inputs, segments, scheduler, placement.node(i), sketch, stats); },
+                                              std::max<std::size_t>(4 * options.top, 1024));
+            mergeTables(sketches);
+            for (const auto &[rows, name] : sketches.front().candidates(2 * options.top))
+            {
+                names.emplace_back(name);
+            }
+            distinct = sketches.front().distinct();
+        }
+
+        auto scheduler = SegmentScheduler{0, segments.size(), 1, placement.nodeThreads()};
+        auto tables = runPlaced<Candidates>(placement, threadStats, [&](unsigned i, Candidates &table, ThreadStats &stats)
+                                            { processInputs(inputs, segments, scheduler, placement.node(i), table, stats); },
+                                            names);
+        mergeTables(tables);
+        const auto &candidates = tables.front().candidates();
+
+        // Keep the k stations with the most rows, the other candidates join the tail
+        auto ranked = std::vector<std::pair<std::uint64_t, std::string_view>>{};
+        for (const auto &[name, measurements] : candidates)
+        {
+            if (measurements.count() != 0)
+            {
+                ranked.emplace_back(measurements.count(), name);
+            }
+        }
+        std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b)
+                  { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+
+        auto keys = std::vector<std::string_view>{};
+        auto tail = tables.front().tail();
+        for (auto i = std::size_t{0}; i < ranked.size(); i++)
+        {
+            if (i < options.top)
+            {
+                keys.push_back(ranked[i].second);
+            }
+            else
+            {
+                tail.merge(candidates.at(ranked[i].second));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+
+        if (!writeResult(candidates, keys, true))
+        {
+            return 1;
+        }
+
+        auto others = static_cast<std::uint64_t>(std::max(0.0, std::round(distinct) - static_cast<double>(keys.size())));
+        std::cout << "others: ~" << others << " stations, " << tail.count() << " rows";
+        if (tail.count() != 0)
+        {
+            std::cout << ", " << tail;
+        }
+        std::cout << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Turns the input arguments into file names: a directory stands for the regular files in it and a pattern
+// with *, ? or [ for the files it matches (for patterns the shell did not expand, e.g. quoted ones)
+auto expandInputs(const std::vector<const char *> &arguments) -> std::vector<std::string>
+{
+    auto inputs = std::vector<std::string>{};
+    for (auto argument : arguments)
+    {
+        if (std::string_view{argument} != "-" && std::strpbrk(argument, "*?[") != nullptr)
+        {
+            glob_t matches;
+            auto status = ::glob(argument, 0, nullptr, &matches);
+            if (status == 0)
+            {
+                inputs.insert(inputs.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+            }
+            ::globfree(&matches);
+            if (status != 0)
+            {
+                throw std::runtime_error{std::string{"No input matches "} + argument};
+            }
+        }
+        else if (std::filesystem::is_directory(argument))
+        {
+            auto first = inputs.size();
+            for (const auto &entry : std::filesystem::directory_iterator{argument})
+            {
+                if (entry.is_regular_file())
+                {
+                    inputs.push_back(entry.path().string());
+                }
+            }
+            std::sort(inputs.begin() + static_cast<std::ptrdiff_t>(first), inputs.end());
+        }
+        else
+        {
+            inputs.emplace_back(argument);
+        }
+    }
+    return inputs;
+}
+
+// Aggregates a pipe, FIFO or terminal: the calling thread reads segment-sized blocks into a ring shared with
+// the parser threads, and a reporter thread prints the aggregate so far every N rows and/or T seconds.
+// The length of a stream is unknown, so it always counts with the wide accumulators or the histograms.
+template <typename Measurements>
+auto runStream(const Options &options) -> int
+{
+    using Map = MapType<Measurements>;
+    using Clock = std::chrono::steady_clock;
+
+    auto fd = STDIN_FILENO;
+    if (std::string_view{options.fileName} != "-")
+    {
+        fd = ::open(options.fileName, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << std::system_error{errno, std::generic_category(), options.fileName}.what() << std::endl;
+            return 1;
+        }
+    }
+
+    auto placement = ThreadPlacement{options.threads, options.smt};
+    auto numberOfThreads = placement.threads();
+    auto stationMaps = std::vector<Map>{numberOfThreads};
+    auto threadStats = std::vector<ThreadStats>{numberOfThreads};
+    auto mutexes = std::vector<std::mutex>(static_cast<std::size_t>(numberOfThreads));
+
+    // Every parser can hold one block while the reader fills another
+    auto ring = BlockRing{static_cast<std::size_t>(numberOfThreads) + 2, options.segmentSize};
+    auto progress = Progress{options.reportRows};
+
+    auto counters = std::optional<PerfCounters>{};
+    if (options.printStats)
+    {
+        counters.emplace();
+        counters->enable();
+    }
+
+    auto scanStart = Clock::now();
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0u; i < numberOfThreads; i++)
+    {
+        threads.push_back(std::thread{[&, i]
+                                      {
+                                          placement.pin(i);
+                                          processBlocks(ring, stationMaps[i], mutexes[i], progress, threadStats[i]);
+                                      }});
+    }
+
+    // Snapshots merge the thread tables one at a time under their lock, so parsing never stops
+    auto reporter = std::thread{};
+    auto reported = true;
+    if (options.reportRows != 0 || options.reportInterval != std::chrono::milliseconds::zero())
+    {
+        reporter = std::thread{[&]
+                               {
+                                   for (auto rows = std::uint64_t{0}; progress.wait(rows, options.reportInterval) && reported;)
+                                   {
+                                       auto snapshot = Map{};
+                                       for (auto i = std::size_t{0}; i < stationMaps.size(); i++)
+                                       {
+                                           auto lock = std::lock_guard{mutexes[i]};
+                                           snapshot.merge(stationMaps[i]);
+                                       }
+                                       reported = writeResult(snapshot, sortedKeys(snapshot), true);
+                                   }
+                               }};
+    }
+
+    auto error = readBlocks(fd, ring);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    progress.finish();
+    if (reporter.joinable())
+    {
+        reporter.join();
+    }
+    if (fd != STDIN_FILENO)
+    {
+        ::close(fd);
+    }
+
+    if (error != 0)
+    {
+        std::cerr << std::system_error{error, std::generic_category(), "read"}.what() << std::endl;
+        return 1;
+    }
+    if (!reported)
+    {
+        return 1;
+    }
+
+    return finish(stationMaps, threadStats, counters, Clock::now() - scanStart);
+}
+
+// Turns the text input into the columnar format. Single-threaded, ids follow the order of first appearance.
+auto convert(const Options &options) -> int
+{
+    try
+    {
+        auto file = MappedFile{options.fileName};
+        auto writer = ColumnarWriter{options.convert};
+        Parser{}(file.data(), file.data() + file.size(), writer);
+
+        auto header = writer.finish();
+        std::cerr << "Wrote " << header.rows << " rows of " << header.stations << " stations in "
+                  << header.blocks << " blocks to " << options.convert << std::endl;
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Sums the block footers alone when there is no --range. With one, the threads take blocks from the
+// shared cursor (one block per segment) and test only the rows the footers cannot settle.
+template <typename Measurements>
+auto aggregateColumnar(const ColumnarFile &file, const Options &options) -> int
+{
+    using Map = MapType<Measurements>;
+
+    auto stationCount = file.names().size();
+    auto totals = std::vector<Measurements>(stationCount);
+
+    if (!options.rangeFilter)
+    {
+        for (const auto &block : file.blocks())
+        {
+            for (const auto &entry : file.footer(block))
+            {
+                totals[entry.station].merge(Measurements::fromState({entry.sum, entry.count, entry.min, entry.max}));
+            }
+        }
+    }
+    else
+    {
+        auto placement = ThreadPlacement{options.threads, options.smt};
+        auto threadTotals = std::vector<std::vector<Measurements>>(placement.threads());
+        auto scheduler = SegmentScheduler{0, file.blocks().size(), 1, placement.nodeThreads()};
+        auto corrupt = std::atomic<bool>{false};
+
+        auto threads = std::vector<std::thread>{};
+        for (auto i = 0u; i < placement.threads(); i++)
+        {
+            threads.push_back(std::thread{[&, i]
+                                          {
+                                              placement.pin(i);
+                                              threadTotals[i].resize(stationCount);
+                                              auto straddling = std::vector<std::uint8_t>(stationCount);
+                                              for (std::size_t block, end; !corrupt.load(std::memory_order_relaxed) && scheduler.next(block, end, placement.node(i));)
+                                              {
+                                                  if (!aggregateBlock(file, file.blocks()[block], options.rangeMin, options.rangeMax, threadTotals[i], straddling))
+                                                  {
+                                                      corrupt.store(true, std::memory_order_relaxed);
+                                                  }
+                                              }
+                                          }});
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        if (corrupt)
+        {
+            throw ColumnarFile::corrupt(options.fileName);
+        }
+
+        for (const auto &threadTotal : threadTotals)
+        {
+            for (auto station = std::size_t{0}; station < stationCount; station++)
+            {
+                totals[station].merge(threadTotal[station]);
+            }
+        }
+    }
+
+    auto stations = Map{};
+    for (auto station = std::size_t{0}; station < stationCount; station++)
+    {
+        if (totals[station].count() != 0)
+        {
+            stations[file.names()[station]].merge(totals[station]);
+        }
+    }
+    return writeResult(stations, sortedKeys(stations), false) ? 0 : 1;
+}
+
+auto runColumnar(const Options &options) -> int
+{
+    try
+    {
+        auto file = ColumnarFile{options.fileName};
+        if (options.wide || file.header().rows >= std::numeric_limits<std::uint32_t>::max())
+        {
+            return aggregateColumnar<WideMeasurements>(file, options);
+        }
+        return aggregateColumnar<CompactMeasurements>(file, options);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// Parses "<min>,<max>" in degrees into tenths
+auto parseRange(const char *text, std::int16_t &min, std::int16_t &max)
+{
+    char *end;
+    auto low = std::strtod(text, &end);
+    if (end == text || *end != ',')
+    {
+        return false;
+    }
+    auto high = std::strtod(end + 1, &end);
+    if (*end != '\0' || !(low <= high))
+    {
+        return false;
+    }
+
+    min = static_cast<std::int16_t>(std::lround(std::clamp(low, -100.0, 100.0) * 10));
+    max = static_cast<std::int16_t>(std::lround(std::clamp(high, -100.0, 100.0) * 10));
+    return true;
+}
+
+void usage()
+{
+    std::cerr << "Usage: calculate_average [--reader=mmap|ifstream|uring] [--segment-size=<MiB>] [--threads=<n>] [--no-smt]\n"
+                 "                         [--table=per-thread|shared]\n"
+                 "                         [--wide] [--percentiles] [--top=<k>] [--stats] [--every-rows=<n>] [--every-seconds=<s>] [--checkpoint=<file>]\n"
+                 "                         [--convert=<columnar file>] [--range=<min>,<max>] [file|directory|pattern|-]..." << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    auto options = Options{};
+    auto arguments = std::vector<const char *>{};
+
+    for (auto i = 1; i < argc; i++)
+    {
+        auto arg = std::string_view{argv[i]};
+        if (arg == "--reader=mmap")
+        {
+            options.reader = Reader::Mapped;
+        }
+        else if (arg == "--reader=ifstream")
+        {
+            options.reader = Reader::Stream;
+        }
+        else if (arg == "--reader=uring")
+        {
+            options.reader = Reader::Uring;
+        }
+        else if (arg.substr(0, 15) == "--segment-size=" && std::atoi(argv[i] + 15) > 0)
+        {
+            options.segmentSize = static_cast<std::size_t>(std::atoi(argv[i] + 15)) << 20;
+        }
+        else if (arg.substr(0, 10) == "--threads=" && std::atoi(argv[i] + 10) > 0)
+        {
+            options.threads = static_cast<unsigned>(std::atoi(argv[i] + 10));
+        }
+        else if (arg == "--table=per-thread")
+        {
+            options.table = Table::PerThread;
+        }
+        else if (arg == "--table=shared")
+        {
+            options.table = Table::Shared;
+        }
+        else if (arg == "--no-smt")
+        {
+            options.smt = false;
+        }
+        else if (arg == "--wide")
+        {
+            options.wide = true;
+        }
+        else if (arg.substr(0, 6) == "--top=" && std::atoll(argv[i] + 6) > 0)
+        {
+            options.top = static_cast<std::size_t>(std::atoll(argv[i] + 6));
+        }
+        else if (arg == "--percentiles")
+        {
+            options.percentiles = true;
+        }
+        else if (arg == "--stats")
+        {
+            options.printStats = true;
+        }
+        else if (arg.substr(0, 13) == "--every-rows=" && std::atoll(argv[i] + 13) > 0)
+        {
+            options.reportRows = static_cast<std::uint64_t>(std::atoll(argv[i] + 13));
+        }
+        else if (arg.substr(0, 16) == "--every-seconds=" && std::atof(argv[i] + 16) > 0)
+        {
+            options.reportInterval = std::chrono::milliseconds{static_cast<std::int64_t>(std::atof(argv[i] + 16) * 1000)};
+        }
+        else if (arg.substr(0, 13) == "--checkpoint=" && arg.size() > 13)
+        {
+            options.checkpoint = argv[i] + 13;
+        }
+        else if (arg.substr(0, 10) == "--convert=" && arg.size() > 10)
+        {
+            options.convert = argv[i] + 10;
+        }
+        else if (arg.substr(0, 8) == "--range=" && parseRange(argv[i] + 8, options.rangeMin, options.rangeMax))
+        {
+            options.rangeFilter = true;
+        }
+        else if (arg.substr(0, 2) != "--")
+        {
+            arguments.push_back(argv[i]);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    // Stdin ("-"), pipes and FIFOs have no size to partition, they are streamed instead
+    auto fileSize = std::uintmax_t{0};
+    try
+    {
+        if (!arguments.empty())
+        {
+            options.inputs = expandInputs(arguments);
+            if (options.inputs.empty())
+            {
+                std::cerr << "No input files" << std::endl;
+                return 1;
+            }
+            options.fileName = options.inputs.front().c_str();
+        }
+
+        if (options.top != 0)
+        {
+            auto fileNames = options.inputs.empty() ? std::vector<std::string>{options.fileName} : options.inputs;
+            for (const auto &fileName : fileNames)
+            {
+                if (fileName == "-" || !std::filesystem::is_regular_file(fileName) || ColumnarFile::detect(fileName.c_str()))
+                {
+                    std::cerr << fileName << ": --top reads its inputs twice, they must be text files" << std::endl;
+                    return 1;
+                }
+                fileSize += std::filesystem::file_size(fileName);
+            }
+            if (options.checkpoint != nullptr || options.convert != nullptr || options.rangeFilter || options.percentiles || options.printStats)
+            {
+                std::cerr << "--top cannot be combined with --checkpoint, --convert, --range, --percentiles or --stats" << std::endl;
+                return 1;
+            }
+
+            if (options.wide || fileSize / minLineLength >= std::numeric_limits<std::uint32_t>::max())
+            {
+                return runTop<WideMeasurements>(options, fileNames);
+            }
+            return runTop<CompactMeasurements>(options, fileNames);
+        }
+
+        if (options.inputs.size() > 1)
+        {
+            for (const auto &input : options.inputs)
+            {
+                if (input == "-" || !std::filesystem::is_regular_file(input) || ColumnarFile::detect(input.c_str()))
+                {
+                    std::cerr << input << ": several inputs must all be text files" << std::endl;
+                    return 1;
+                }
+                fileSize += std::filesystem::file_size(input);
+            }
+            if (options.checkpoint != nullptr || options.convert != nullptr || options.rangeFilter)
+            {
+                std::cerr << "--checkpoint, --convert and --range take a single input" << std::endl;
+                return 1;
+            }
+            if (options.reader != Reader::Mapped)
+            {
+                std::cerr << "Several inputs are read with the mmap reader" << std::endl;
+            }
+
+            if (options.percentiles)
+            {
+                return runInputs<HistogramMeasurements>(options);
+            }
+            if (options.wide || fileSize / minLineLength >= std::numeric_limits<std::uint32_t>::max())
+            {
+                return runInputs<WideMeasurements>(options);
+            }
+            return runInputs<CompactMeasurements>(options);
+        }
+
+        if (std::string_view{options.fileName} == "-" || !std::filesystem::is_regular_file(options.fileName))
+        {
+            if (options.checkpoint != nullptr || options.convert != nullptr || options.rangeFilter)
+            {
+                std::cerr << "--checkpoint, --convert and --range need a regular file as input" << std::endl;
+                return 1;
+            }
+            return options.percentiles ? runStream<HistogramMeasurements>(options) : runStream<WideMeasurements>(options);
+        }
+
+        if (options.percentiles && options.checkpoint != nullptr)
+        {
+            std::cerr << "--percentiles cannot resume from a checkpoint" << std::endl;
+            return 1;
+        }
+        if (options.convert != nullptr)
+        {
+            return convert(options);
+        }
+        if (ColumnarFile::detect(options.fileName))
+        {
+            if (options.percentiles)
+            {
+                std::cerr << "--percentiles needs a text input, columnar footers hold no distribution" << std::endl;
+                return 1;
+            }
+            return runColumnar(options);
+        }
+        if (options.rangeFilter)
+        {
+            std::cerr << "--range needs a columnar input, see --convert" << std::endl;
+            return 1;
+        }
+        fileSize = std::filesystem::file_size(options.fileName);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (options.percentiles)
+    {
+        return run<HistogramMeasurements>(options);
+    }
+
+    // Keep the compact 16-byte accumulators unless the input could hold 2^32 rows or more
+    if (options.wide || fileSize / minLineLength >= std::numeric_limits<std::uint32_t>::max())
+    {
+        return run<WideMeasurements>(options);
+    }
+    return run<CompactMeasurements>(options);
+}
@@ -4,13 +4,32 @@
 #include <random>
 #include <cmath>
 #include <iomanip>
-#include <fstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <system_error>
+#include <unordered_set>
+#include <cctype>
+#include <cstdlib>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
 
-// Seed the random generator engine
-static std::default_random_engine generator{
-    std::chrono::duration_cast<std::chrono::duration<std::uint32_t>>(
-        std::chrono::system_clock::now().time_since_epoch())
-        .count()};
+#include "stations.hpp"
+
+using Generator = std::mt19937_64;
+
+// Rows generated (and written with one pwrite) per batch. Every thread holds one batch of at most
+// batchSize * maxLineLength bytes, about 7 MB, so memory stays small on machines with many cores.
+static constexpr auto batchSize = 1 << 16;
+
+// Longest line: a 100 byte station name, ';', "-99.9" and '\n'
+static constexpr auto maxLineLength = std::size_t{100 + 7};
 
 // Define structures
 class WeatherStation
@@ -25,487 +44,406 @@ public:
     {
     }
 
-    constexpr auto id() noexcept -> const std::string &
+    inline auto id() const noexcept -> const std::string &
     {
         return _id;
     }
 
-    inline auto measurement() noexcept -> double
+    // Drops the value the normal distribution caches between calls
+    inline auto reset() noexcept
+    {
+        _distribution.reset();
+    }
+
+    // Measurement in integer tenths, clamped to the -99.9..99.9 range of the challenge
+    inline auto measurement(Generator &generator) noexcept -> int
     {
         double m = _distribution(generator);
-        return std::round(m * 10.0) / 10.0;
+        return static_cast<int>(std::clamp(std::round(m * 10.0), -999.0, 999.0));
+    }
+};
+
+// Writes a tenths value with one decimal, e.g. -123 as "-12.3", and returns the end of the output
+inline auto formatTenths(char *out, int tenths) noexcept -> char *
+{
+    if (tenths < 0)
+    {
+        *out++ = '-';
+        tenths = -tenths;
+    }
+
+    if (tenths >= 100)
+    {
+        *out++ = static_cast<char>('0' + tenths / 100);
+    }
+    *out++ = static_cast<char>('0' + tenths / 10 % 10);
+    *out++ = '.';
+    *out++ = static_cast<char>('0' + tenths % 10);
+    return out;
+}
+
+// Writes the whole buffer at offset, retrying short writes
+auto writeAt(int fd, const char *data, std::size_t size, off_t offset) -> void
+{
+    while (size > 0)
+    {
+        auto written = ::pwrite(fd, data, size, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error{errno, std::generic_category(), "pwrite"};
+        }
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        offset += written;
+    }
+}
+
+// Batches are generated in parallel but take their file offsets in batch order, so the file layout
+// does not depend on the number of threads. Only the offset reservation is serialized.
+class BatchWriter
+{
+    int _fd;
+    std::mutex _mutex;
+    std::condition_variable _turn;
+    std::uint64_t _nextBatch = 0;
+    off_t _nextOffset = 0;
+    std::chrono::system_clock::time_point _start = std::chrono::system_clock::now();
+
+public:
+    explicit BatchWriter(int fd) noexcept : _fd{fd}
+    {
+    }
+
+    auto write(std::uint64_t batch, const std::vector<char> &buffer) -> void
+    {
+        off_t offset;
+        {
+            auto lock = std::unique_lock{_mutex};
+            _turn.wait(lock, [&]
+                       { return _nextBatch == batch; });
+
+            offset = _nextOffset;
+            _nextOffset += static_cast<off_t>(buffer.size());
+            _nextBatch++;
+
+            // Show progress every 50 million records
+            auto records = _nextBatch * batchSize;
+            if (records % 50'000'000 < batchSize && records >= 50'000'000)
+            {
+                auto current = std::chrono::system_clock::now();
+                std::cout << "Wrote " << records << " measurements in "
+                          << std::fixed << std::setprecision(3)
+                          << std::chrono::duration<double, std::milli>(current - _start).count() << " ms\n";
+            }
+        }
+        _turn.notify_all();
+
+        writeAt(_fd, buffer.data(), buffer.size(), offset);
+    }
+
+    auto size() const noexcept
+    {
+        return _nextOffset;
+    }
+};
+
+// Most stations the 1BRC rules allow in one input
+static constexpr auto maxStations = std::size_t{10'000};
+
+// Builds additional unique station names once the catalogue is exhausted. Lengths follow a log-normal
+// distribution around the catalogue median (about 9 bytes) with a small uniform tail up to 100 bytes,
+// and the syllables mix ASCII with 2 and 3 byte UTF-8 characters like the real names do.
+class StationNameSynthesizer
+{
+    static constexpr const char *onsets[] = {
+        "b", "br", "c", "ch", "d", "f", "g", "h", "j", "k", "kh", "l", "m", "n", "p", "r", "s",
+        "sh", "t", "tr", "v", "w", "z", "ç", "ś", "ž", "ł", "ň", "ğ", "ß", "東", "山"};
+    static constexpr const char *nuclei[] = {
+        "a", "e", "i", "o", "u", "ai", "ou", "y", "é", "è", "ü", "ö", "å", "ı", "ã", "ō"};
+    static constexpr const char *codas[] = {"", "", "", "n", "r", "s", "l", "m", "k", "ng", "ł", "ñ"};
+
+    Generator _generator;
+    std::lognormal_distribution<double> _length{std::log(9.0), 0.45};
+    std::bernoulli_distribution _longTail{0.01};
+    std::uniform_int_distribution<std::size_t> _tailLength{25, 100};
+    std::bernoulli_distribution _space{0.12};
+
+    template <std::size_t N>
+    auto pick(const char *const (&parts)[N]) -> std::string_view
+    {
+        return parts[std::uniform_int_distribution<std::size_t>{0, N - 1}(_generator)];
+    }
+
+public:
+    explicit StationNameSynthesizer(std::uint64_t seed) : _generator{seed}
+    {
+    }
+
+    auto operator()() -> std::string
+    {
+        auto length = _longTail(_generator)
+                          ? _tailLength(_generator)
+                          : static_cast<std::size_t>(std::clamp(std::round(_length(_generator)), 2.0, 24.0));
+
+        auto name = std::string{};
+        while (name.size() < length)
+        {
+            auto syllable = std::string{pick(onsets)} + std::string{pick(nuclei)} + std::string{pick(codas)};
+            if (!name.empty() && name.back() != ' ' && name.size() + 2 < length && _space(_generator))
+            {
+                syllable = " " + syllable;
+            }
+
+            // Never exceed 100 bytes and never split a UTF-8 sequence
+            if (name.size() + syllable.size() > 100)
+            {
+                break;
+            }
+            name += syllable;
+        }
+
+        if (name.empty() || name.back() == ' ')
+        {
+            name += 'a';
+        }
+        name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+        return name;
+    }
+};
+
+// Picks the station of each row, uniformly or with Zipf skew: the station of rank k is drawn with
+// probability proportional to 1 / k^s, ranks being a seeded shuffle of the stations
+class StationPicker
+{
+    std::vector<std::size_t> _ranks;
+    std::uniform_int_distribution<std::size_t> _uniform;
+    std::discrete_distribution<std::size_t> _zipf;
+    bool _skewed;
+
+public:
+    StationPicker(std::size_t stations, double skew, std::uint64_t seed)
+        : _ranks(stations), _uniform{0, stations - 1}, _skewed{skew > 0.0}
+    {
+        for (std::size_t i = 0; i < stations; i++)
+        {
+            _ranks[i] = i;
+        }
+
+        if (_skewed)
+        {
+            auto generator = Generator{seed};
+            std::shuffle(_ranks.begin(), _ranks.end(), generator);
+
+            auto weights = std::vector<double>(stations);
+            for (std::size_t k = 0; k < stations; k++)
+            {
+                weights[k] = 1.0 / std::pow(static_cast<double>(k + 1), skew);
+            }
+            _zipf = std::discrete_distribution<std::size_t>{weights.cbegin(), weights.cend()};
+        }
+    }
+
+    inline auto operator()(Generator &generator) -> std::size_t
+    {
+        return _skewed ? _ranks[_zipf(generator)] : _uniform(generator);
     }
 };
 
 void usage()
 {
-    std::cerr << "Usage: create_measurements <number of records to create>" << std::endl;
+    std::cerr << "Usage: create_measurements [--seed=<n>] [--stations=<1..10000>] [--zipf=<s>] <number of records to create>" << std::endl;
+}
+
+// Parses a non-negative decimal integer, rejecting trailing characters
+auto parseCount(const char *text, std::uint64_t &value) noexcept
+{
+    char *end;
+    errno = 0;
+    value = std::strtoull(text, &end, 10);
+    return *text >= '0' && *text <= '9' && *end == '\0' && errno == 0;
 }
 
 // Main entry point of the program
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    std::uint64_t records = 0;
+    auto recordsGiven = false;
+    auto seed = static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    std::uint64_t stationCount = std::size(knownStations);
+    auto skew = 0.0;
+
+    for (auto i = 1; i < argc; i++)
+    {
+        auto arg = std::string_view{argv[i]};
+        auto valid = true;
+
+        if (arg.substr(0, 7) == "--seed=")
+        {
+            valid = parseCount(argv[i] + 7, seed);
+        }
+        else if (arg.substr(0, 11) == "--stations=")
+        {
+            valid = parseCount(argv[i] + 11, stationCount) && stationCount > 0 && stationCount <= maxStations;
+        }
+        else if (arg.substr(0, 7) == "--zipf=")
+        {
+            char *end;
+            skew = std::strtod(argv[i] + 7, &end);
+            valid = *end == '\0' && skew >= 0.0;
+        }
+        else if (!recordsGiven && arg.substr(0, 2) != "--")
+        {
+            valid = parseCount(argv[i], records);
+            recordsGiven = true;
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Invalid argument " << arg << std::endl;
+            usage();
+            return 1;
+        }
+    }
+
+    if (!recordsGiven)
     {
         usage();
         return 1;
     }
 
-    int records;
+    // The catalogue stations come first, synthesized ones fill up the requested count
+    std::vector<WeatherStation> stations;
+    for (const auto &[name, meanTemperature] : knownStations)
+    {
+        if (stations.size() < stationCount)
+        {
+            stations.emplace_back(std::string{name}, meanTemperature);
+        }
+    }
 
-    try
+    auto names = std::unordered_set<std::string>{};
+    for (const auto &station : stations)
     {
-        records = std::stoi(argv[1]);
+        names.insert(station.id());
     }
-    catch (std::invalid_argument &)
+
+    auto synthesize = StationNameSynthesizer{seed ^ 0x9e3779b97f4a7c15};
+    auto temperatureGenerator = Generator{seed ^ 0x7f4a7c159e3779b9};
+    auto meanTemperature = std::uniform_real_distribution<double>{-10.0, 30.0};
+    while (stations.size() < stationCount)
     {
-        std::cerr << "Invalid value for <number of records to create>" << std::endl;
-        usage();
+        auto name = synthesize();
+        if (names.insert(name).second)
+        {
+            stations.emplace_back(name, std::round(meanTemperature(temperatureGenerator) * 10.0) / 10.0);
+        }
+    }
+
+    auto picker = StationPicker{stations.size(), skew, seed ^ 0x2545f4914f6cdd1d};
+    auto averageLineLength = 0.0;
+    for (const auto &station : stations)
+    {
+        averageLineLength += static_cast<double>(station.id().size() + 6) / static_cast<double>(stations.size());
+    }
 
+    // Generate records
+    auto fd = ::open("measurements.txt", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << std::system_error{errno, std::generic_category(), "measurements.txt"}.what() << std::endl;
         return 1;
     }
 
-    std::vector<WeatherStation> stations{
-        {"Abha", 18.0},
-        {"Abidjan", 26.0},
-        {"Abéché", 29.4},
-        {"Accra", 26.4},
-        {"Addis Ababa", 16.0},
-        {"Adelaide", 17.3},
-        {"Aden", 29.1},
-        {"Ahvaz", 25.4},
-        {"Albuquerque", 14.0},
-        {"Alexandra", 11.0},
-        {"Alexandria", 20.0},
-        {"Algiers", 18.2},
-        {"Alice Springs", 21.0},
-        {"Almaty", 10.0},
-        {"Amsterdam", 10.2},
-        {"Anadyr", -6.9},
-        {"Anchorage", 2.8},
-        {"Andorra la Vella", 9.8},
-        {"Ankara", 12.0},
-        {"Antananarivo", 17.9},
-        {"Antsiranana", 25.2},
-        {"Arkhangelsk", 1.3},
-        {"Ashgabat", 17.1},
-        {"Asmara", 15.6},
-        {"Assab", 30.5},
-        {"Astana", 3.5},
-        {"Athens", 19.2},
-        {"Atlanta", 17.0},
-        {"Auckland", 15.2},
-        {"Austin", 20.7},
-        {"Baghdad", 22.77},
-        {"Baguio", 19.5},
-        {"Baku", 15.1},
-        {"Baltimore", 13.1},
-        {"Bamako", 27.8},
-        {"Bangkok", 28.6},
-        {"Bangui", 26.0},
-        {"Banjul", 26.0},
-        {"Barcelona", 18.2},
-        {"Bata", 25.1},
-        {"Batumi", 14.0},
-        {"Beijing", 12.9},
-        {"Beirut", 20.9},
-        {"Belgrade", 12.5},
-        {"Belize City", 26.7},
-        {"Benghazi", 19.9},
-        {"Bergen", 7.7},
-        {"Berlin", 10.3},
-        {"Bilbao", 14.7},
-        {"Birao", 26.5},
-        {"Bishkek", 11.3},
-        {"Bissau", 27.0},
-        {"Blantyre", 22.2},
-        {"Bloemfontein", 15.6},
-        {"Boise", 11.4},
-        {"Bordeaux", 14.2},
-        {"Bosaso", 30.0},
-        {"Boston", 10.9},
-        {"Bouaké", 26.0},
-        {"Bratislava", 10.5},
-        {"Brazzaville", 25.0},
-        {"Bridgetown", 27.0},
-        {"Brisbane", 21.4},
-        {"Brussels", 10.5},
-        {"Bucharest", 10.8},
-        {"Budapest", 11.3},
-        {"Bujumbura", 23.8},
-        {"Bulawayo", 18.9},
-        {"Burnie", 13.1},
-        {"Busan", 15.0},
-        {"Cabo San Lucas", 23.9},
-        {"Cairns", 25.0},
-        {"Cairo", 21.4},
-        {"Calgary", 4.4},
-        {"Canberra", 13.1},
-        {"Cape Town", 16.2},
-        {"Changsha", 17.4},
-        {"Charlotte", 16.1},
-        {"Chiang Mai", 25.8},
-        {"Chicago", 9.8},
-        {"Chihuahua", 18.6},
-        {"Chișinău", 10.2},
-        {"Chittagong", 25.9},
-        {"Chongqing", 18.6},
-        {"Christchurch", 12.2},
-        {"City of San Marino", 11.8},
-        {"Colombo", 27.4},
-        {"Columbus", 11.7},
-        {"Conakry", 26.4},
-        {"Copenhagen", 9.1},
-        {"Cotonou", 27.2},
-        {"Cracow", 9.3},
-        {"Da Lat", 17.9},
-        {"Da Nang", 25.8},
-        {"Dakar", 24.0},
-        {"Dallas", 19.0},
-        {"Damascus", 17.0},
-        {"Dampier", 26.4},
-        {"Dar es Salaam", 25.8},
-        {"Darwin", 27.6},
-        {"Denpasar", 23.7},
-        {"Denver", 10.4},
-        {"Detroit", 10.0},
-        {"Dhaka", 25.9},
-        {"Dikson", -11.1},
-        {"Dili", 26.6},
-        {"Djibouti", 29.9},
-        {"Dodoma", 22.7},
-        {"Dolisie", 24.0},
-        {"Douala", 26.7},
-        {"Dubai", 26.9},
-        {"Dublin", 9.8},
-        {"Dunedin", 11.1},
-        {"Durban", 20.6},
-        {"Dushanbe", 14.7},
-        {"Edinburgh", 9.3},
-        {"Edmonton", 4.2},
-        {"El Paso", 18.1},
-        {"Entebbe", 21.0},
-        {"Erbil", 19.5},
-        {"Erzurum", 5.1},
-        {"Fairbanks", -2.3},
-        {"Fianarantsoa", 17.9},
-        {"Flores,  Petén", 26.4},
-        {"Frankfurt", 10.6},
-        {"Fresno", 17.9},
-        {"Fukuoka", 17.0},
-        {"Gabès", 19.5},
-        {"Gaborone", 21.0},
-        {"Gagnoa", 26.0},
-        {"Gangtok", 15.2},
-        {"Garissa", 29.3},
-        {"Garoua", 28.3},
-        {"George Town", 27.9},
-        {"Ghanzi", 21.4},
-        {"Gjoa Haven", -14.4},
-        {"Guadalajara", 20.9},
-        {"Guangzhou", 22.4},
-        {"Guatemala City", 20.4},
-        {"Halifax", 7.5},
-        {"Hamburg", 9.7},
-        {"Hamilton", 13.8},
-        {"Hanga Roa", 20.5},
-        {"Hanoi", 23.6},
-        {"Harare", 18.4},
-        {"Harbin", 5.0},
-        {"Hargeisa", 21.7},
-        {"Hat Yai", 27.0},
-        {"Havana", 25.2},
-        {"Helsinki", 5.9},
-        {"Heraklion", 18.9},
-        {"Hiroshima", 16.3},
-        {"Ho Chi Minh City", 27.4},
-        {"Hobart", 12.7},
-        {"Hong Kong", 23.3},
-        {"Honiara", 26.5},
-        {"Honolulu", 25.4},
-        {"Houston", 20.8},
-        {"Ifrane", 11.4},
-        {"Indianapolis", 11.8},
-        {"Iqaluit", -9.3},
-        {"Irkutsk", 1.0},
-        {"Istanbul", 13.9},
-        {"İzmir", 17.9},
-        {"Jacksonville", 20.3},
-        {"Jakarta", 26.7},
-        {"Jayapura", 27.0},
-        {"Jerusalem", 18.3},
-        {"Johannesburg", 15.5},
-        {"Jos", 22.8},
-        {"Juba", 27.8},
-        {"Kabul", 12.1},
-        {"Kampala", 20.0},
-        {"Kandi", 27.7},
-        {"Kankan", 26.5},
-        {"Kano", 26.4},
-        {"Kansas City", 12.5},
-        {"Karachi", 26.0},
-        {"Karonga", 24.4},
-        {"Kathmandu", 18.3},
-        {"Khartoum", 29.9},
-        {"Kingston", 27.4},
-        {"Kinshasa", 25.3},
-        {"Kolkata", 26.7},
-        {"Kuala Lumpur", 27.3},
-        {"Kumasi", 26.0},
-        {"Kunming", 15.7},
-        {"Kuopio", 3.4},
-        {"Kuwait City", 25.7},
-        {"Kyiv", 8.4},
-        {"Kyoto", 15.8},
-        {"La Ceiba", 26.2},
-        {"La Paz", 23.7},
-        {"Lagos", 26.8},
-        {"Lahore", 24.3},
-        {"Lake Havasu City", 23.7},
-        {"Lake Tekapo", 8.7},
-        {"Las Palmas de Gran Canaria", 21.2},
-        {"Las Vegas", 20.3},
-        {"Launceston", 13.1},
-        {"Lhasa", 7.6},
-        {"Libreville", 25.9},
-        {"Lisbon", 17.5},
-        {"Livingstone", 21.8},
-        {"Ljubljana", 10.9},
-        {"Lodwar", 29.3},
-        {"Lomé", 26.9},
-        {"London", 11.3},
-        {"Los Angeles", 18.6},
-        {"Louisville", 13.9},
-        {"Luanda", 25.8},
-        {"Lubumbashi", 20.8},
-        {"Lusaka", 19.9},
-        {"Luxembourg City", 9.3},
-        {"Lviv", 7.8},
-        {"Lyon", 12.5},
-        {"Madrid", 15.0},
-        {"Mahajanga", 26.3},
-        {"Makassar", 26.7},
-        {"Makurdi", 26.0},
-        {"Malabo", 26.3},
-        {"Malé", 28.0},
-        {"Managua", 27.3},
-        {"Manama", 26.5},
-        {"Mandalay", 28.0},
-        {"Mango", 28.1},
-        {"Manila", 28.4},
-        {"Maputo", 22.8},
-        {"Marrakesh", 19.6},
-        {"Marseille", 15.8},
-        {"Maun", 22.4},
-        {"Medan", 26.5},
-        {"Mek'ele", 22.7},
-        {"Melbourne", 15.1},
-        {"Memphis", 17.2},
-        {"Mexicali", 23.1},
-        {"Mexico City", 17.5},
-        {"Miami", 24.9},
-        {"Milan", 13.0},
-        {"Milwaukee", 8.9},
-        {"Minneapolis", 7.8},
-        {"Minsk", 6.7},
-        {"Mogadishu", 27.1},
-        {"Mombasa", 26.3},
-        {"Monaco", 16.4},
-        {"Moncton", 6.1},
-        {"Monterrey", 22.3},
-        {"Montreal", 6.8},
-        {"Moscow", 5.8},
-        {"Mumbai", 27.1},
-        {"Murmansk", 0.6},
-        {"Muscat", 28.0},
-        {"Mzuzu", 17.7},
-        {"N'Djamena", 28.3},
-        {"Naha", 23.1},
-        {"Nairobi", 17.8},
-        {"Nakhon Ratchasima", 27.3},
-        {"Napier", 14.6},
-        {"Napoli", 15.9},
-        {"Nashville", 15.4},
-        {"Nassau", 24.6},
-        {"Ndola", 20.3},
-        {"New Delhi", 25.0},
-        {"New Orleans", 20.7},
-        {"New York City", 12.9},
-        {"Ngaoundéré", 22.0},
-        {"Niamey", 29.3},
-        {"Nicosia", 19.7},
-        {"Niigata", 13.9},
-        {"Nouadhibou", 21.3},
-        {"Nouakchott", 25.7},
-        {"Novosibirsk", 1.7},
-        {"Nuuk", -1.4},
-        {"Odesa", 10.7},
-        {"Odienné", 26.0},
-        {"Oklahoma City", 15.9},
-        {"Omaha", 10.6},
-        {"Oranjestad", 28.1},
-        {"Oslo", 5.7},
-        {"Ottawa", 6.6},
-        {"Ouagadougou", 28.3},
-        {"Ouahigouya", 28.6},
-        {"Ouarzazate", 18.9},
-        {"Oulu", 2.7},
-        {"Palembang", 27.3},
-        {"Palermo", 18.5},
-        {"Palm Springs", 24.5},
-        {"Palmerston North", 13.2},
-        {"Panama City", 28.0},
-        {"Parakou", 26.8},
-        {"Paris", 12.3},
-        {"Perth", 18.7},
-        {"Petropavlovsk-Kamchatsky", 1.9},
-        {"Philadelphia", 13.2},
-        {"Phnom Penh", 28.3},
-        {"Phoenix", 23.9},
-        {"Pittsburgh", 10.8},
-        {"Podgorica", 15.3},
-        {"Pointe-Noire", 26.1},
-        {"Pontianak", 27.7},
-        {"Port Moresby", 26.9},
-        {"Port Sudan", 28.4},
-        {"Port Vila", 24.3},
-        {"Port-Gentil", 26.0},
-        {"Portland (OR)", 12.4},
-        {"Porto", 15.7},
-        {"Prague", 8.4},
-        {"Praia", 24.4},
-        {"Pretoria", 18.2},
-        {"Pyongyang", 10.8},
-        {"Rabat", 17.2},
-        {"Rangpur", 24.4},
-        {"Reggane", 28.3},
-        {"Reykjavík", 4.3},
-        {"Riga", 6.2},
-        {"Riyadh", 26.0},
-        {"Rome", 15.2},
-        {"Roseau", 26.2},
-        {"Rostov-on-Don", 9.9},
-        {"Sacramento", 16.3},
-        {"Saint Petersburg", 5.8},
-        {"Saint-Pierre", 5.7},
-        {"Salt Lake City", 11.6},
-        {"San Antonio", 20.8},
-        {"San Diego", 17.8},
-        {"San Francisco", 14.6},
-        {"San Jose", 16.4},
-        {"San José", 22.6},
-        {"San Juan", 27.2},
-        {"San Salvador", 23.1},
-        {"Sana'a", 20.0},
-        {"Santo Domingo", 25.9},
-        {"Sapporo", 8.9},
-        {"Sarajevo", 10.1},
-        {"Saskatoon", 3.3},
-        {"Seattle", 11.3},
-        {"Ségou", 28.0},
-        {"Seoul", 12.5},
-        {"Seville", 19.2},
-        {"Shanghai", 16.7},
-        {"Singapore", 27.0},
-        {"Skopje", 12.4},
-        {"Sochi", 14.2},
-        {"Sofia", 10.6},
-        {"Sokoto", 28.0},
-        {"Split", 16.1},
-        {"St. John's", 5.0},
-        {"St. Louis", 13.9},
-        {"Stockholm", 6.6},
-        {"Surabaya", 27.1},
-        {"Suva", 25.6},
-        {"Suwałki", 7.2},
-        {"Sydney", 17.7},
-        {"Tabora", 23.0},
-        {"Tabriz", 12.6},
-        {"Taipei", 23.0},
-        {"Tallinn", 6.4},
-        {"Tamale", 27.9},
-        {"Tamanrasset", 21.7},
-        {"Tampa", 22.9},
-        {"Tashkent", 14.8},
-        {"Tauranga", 14.8},
-        {"Tbilisi", 12.9},
-        {"Tegucigalpa", 21.7},
-        {"Tehran", 17.0},
-        {"Tel Aviv", 20.0},
-        {"Thessaloniki", 16.0},
-        {"Thiès", 24.0},
-        {"Tijuana", 17.8},
-        {"Timbuktu", 28.0},
-        {"Tirana", 15.2},
-        {"Toamasina", 23.4},
-        {"Tokyo", 15.4},
-        {"Toliara", 24.1},
-        {"Toluca", 12.4},
-        {"Toronto", 9.4},
-        {"Tripoli", 20.0},
-        {"Tromsø", 2.9},
-        {"Tucson", 20.9},
-        {"Tunis", 18.4},
-        {"Ulaanbaatar", -0.4},
-        {"Upington", 20.4},
-        {"Ürümqi", 7.4},
-        {"Vaduz", 10.1},
-        {"Valencia", 18.3},
-        {"Valletta", 18.8},
-        {"Vancouver", 10.4},
-        {"Veracruz", 25.4},
-        {"Vienna", 10.4},
-        {"Vientiane", 25.9},
-        {"Villahermosa", 27.1},
-        {"Vilnius", 6.0},
-        {"Virginia Beach", 15.8},
-        {"Vladivostok", 4.9},
-        {"Warsaw", 8.5},
-        {"Washington, D.C.", 14.6},
-        {"Wau", 27.8},
-        {"Wellington", 12.9},
-        {"Whitehorse", -0.1},
-        {"Wichita", 13.9},
-        {"Willemstad", 28.0},
-        {"Winnipeg", 3.0},
-        {"Wrocław", 9.6},
-        {"Xi'an", 14.1},
-        {"Yakutsk", -8.8},
-        {"Yangon", 27.5},
-        {"Yaoundé", 23.8},
-        {"Yellowknife", -4.3},
-        {"Yerevan", 12.4},
-        {"Yinchuan", 9.0},
-        {"Zagreb", 10.7},
-        {"Zanzibar City", 26.0},
-        {"Zürich", 9.3}};
-
-    // Initialize distribution to select a random station
-    std::uniform_int_distribution<std::size_t> stationDistribution{0, stations.size() - 1};
+    // Reserve the expected size up front, the file is truncated to the exact size at the end
+    ::posix_fallocate(fd, 0, static_cast<off_t>(averageLineLength * records));
 
-    // Generate records
-    std::ofstream file{"measurements.txt"};
     auto start = std::chrono::system_clock::now();
+    auto writer = BatchWriter{fd};
+    auto batches = (records + batchSize - 1) / batchSize;
+    auto nextBatch = std::atomic<std::uint64_t>{0};
+    auto failed = std::atomic<bool>{false};
 
-    for (int i = 0; i < records; i++)
+    auto generate = [&]
     {
-        // Show progress every 50 million records
-        if (i > 0 && i % 50'000'000 == 0)
+        // Every thread draws from its own copy of the stations, the distributions keep internal state
+        auto threadStations = stations;
+        auto stationDistribution = picker;
+        auto buffer = std::vector<char>{};
+
+        for (std::uint64_t batch; !failed && (batch = nextBatch.fetch_add(1)) < batches;)
         {
-            auto current = std::chrono::system_clock::now();
-            std::cout << "Wrote " << i << " measurements in "
-                      << std::fixed << std::setprecision(3)
-                      << std::chrono::duration<double, std::milli>(current - start).count() << " ms\n";
+            // Each batch has its own random stream, so its rows do not depend on which thread generates it
+            auto seeds = std::seed_seq{seed, seed >> 32, batch, batch >> 32};
+            auto generator = Generator{seeds};
+            for (auto &station : threadStations)
+            {
+                station.reset();
+            }
+
+            auto rows = std::min<std::uint64_t>(batchSize, records - batch * batchSize);
+            buffer.resize(rows * maxLineLength);
+            auto out = buffer.data();
+
+            for (std::uint64_t i = 0; i < rows; i++)
+            {
+                auto &station = threadStations[stationDistribution(generator)];
+                const auto &id = station.id();
+                out = std::copy(id.cbegin(), id.cend(), out);
+                *out++ = ';';
+                out = formatTenths(out, station.measurement(generator));
+                *out++ = '\n';
+            }
+            buffer.resize(static_cast<std::size_t>(out - buffer.data()));
+
+            try
+            {
+                writer.write(batch, buffer);
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << e.what() << std::endl;
+                failed = true;
+            }
         }
+    };
+
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 1u; i < std::max(1u, std::thread::hardware_concurrency()); i++)
+    {
+        threads.emplace_back(generate);
+    }
+    generate();
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (failed)
+    {
+        return 1;
+    }
 
-        auto &station = stations[stationDistribution(generator)];
-        file << station.id() << ";" << std::fixed << std::setprecision(1) << station.measurement() << "\n";
+    if (::ftruncate(fd, writer.size()) < 0 || ::close(fd) < 0)
+    {
+        std::cerr << std::system_error{errno, std::generic_category(), "measurements.txt"}.what() << std::endl;
+        return 1;
     }
 
     // Show total execution time
     auto current = std::chrono::system_clock::now();
-    std::cout << "Created file with " << records << " measurements in "
+    std::cout << "Created file with " << records << " measurements from " << stations.size()
+              << " stations (seed " << seed << ") in "
         << std::chrono::duration<double, std::milli>(current - start).count() << " ms\n";
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only view of the whole input file mapped straight from the page cache
+class MappedFile
+{
+    const char *_data = nullptr;
+    std::size_t _size = 0;
+
+    auto map(int fd, const char *name) -> void
+    {
+        struct stat st;
+        if (::fstat(fd, &st) < 0)
+        {
+            throw std::system_error{errno, std::generic_category(), name};
+        }
+
+        _size = static_cast<std::size_t>(st.st_size);
+        if (_size > 0)
+        {
+            auto data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                throw std::system_error{errno, std::generic_category(), name};
+            }
+
+            _data = static_cast<const char *>(data);
+
+            // The input is scanned front to back exactly once
+            ::madvise(data, _size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+            ::madvise(data, _size, MADV_HUGEPAGE);
+#endif
+        }
+    }
+
+public:
+    explicit MappedFile(const char *path)
+    {
+        auto fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::system_error{errno, std::generic_category(), path};
+        }
+
+        try
+        {
+            map(fd, path);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+    }
+
+    // Maps the file open on fd, the descriptor stays with the caller
+    MappedFile(int fd, const char *name)
+    {
+        map(fd, name);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (_data != nullptr)
+        {
+            ::munmap(const_cast<char *>(_data), _size);
+        }
+    }
+
+    constexpr auto data() const noexcept
+    {
+        return _data;
+    }
+
+    constexpr auto size() const noexcept
+    {
+        return _size;
+    }
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
+
+// Fields of BasicMeasurements independent of the count width, as persisted in checkpoints
+struct MeasurementsState
+{
+    std::int64_t sum;
+    std::uint64_t count;
+    std::int16_t min;
+    std::int16_t max;
+};
+
+// Running min/max/sum/count of one station in integer tenths. The count type picks the layout: the
+// compact one (32-bit count) is 16 bytes and holds any input of less than 2^32 rows, the wide one
+// counts in 64 bits for larger inputs. The 64-bit sum only overflows past 9 * 10^15 rows.
+template <typename CountType>
+struct BasicMeasurements
+{
+    using ValType = std::int32_t;
+
+    constexpr auto state() const noexcept
+    {
+        return MeasurementsState{_sum, _count, _min, _max};
+    }
+
+    static constexpr auto fromState(const MeasurementsState &state) noexcept
+    {
+        auto measurements = BasicMeasurements{};
+        measurements._sum = state.sum;
+        measurements._count = static_cast<CountType>(state.count);
+        measurements._min = state.min;
+        measurements._max = state.max;
+        return measurements;
+    }
+
+    inline auto record(ValType measurement) noexcept
+    {
+        _min = std::min(_min, static_cast<std::int16_t>(measurement));
+        _max = std::max(_max, static_cast<std::int16_t>(measurement));
+        _sum += measurement;
+        _count++;
+    }
+
+    constexpr auto count() const noexcept
+    {
+        return _count;
+    }
+
+    // Mean in tenths, rounded half up like Java's Math.round (std::round rounds half away from zero)
+    constexpr auto meanTenths() const noexcept -> std::int64_t
+    {
+        auto count = static_cast<std::int64_t>(_count);
+        auto numerator = 2 * _sum + count;
+        auto denominator = 2 * count;
+        return numerator / denominator - (numerator % denominator != 0 && numerator < 0);
+    }
+
+    inline auto merge(const BasicMeasurements &measurements) noexcept
+    {
+        _min = std::min(_min, measurements._min);
+        _max = std::max(_max, measurements._max);
+        _sum += measurements._sum;
+        _count += measurements._count;
+    }
+
+    // Writes a tenths value with one decimal, e.g. -123 as "-12.3", and returns the end of the output
+    static inline auto formatTenths(char *out, std::int64_t tenths) noexcept -> char *
+    {
+        auto value = static_cast<std::uint64_t>(tenths);
+        if (tenths < 0)
+        {
+            *out++ = '-';
+            value = ~value + 1;
+        }
+
+        char digits[20];
+        auto digit = digits + sizeof(digits);
+        *--digit = static_cast<char>('0' + value % 10);
+        *--digit = '.';
+        value /= 10;
+        do
+        {
+            *--digit = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        auto length = static_cast<std::size_t>(digits + sizeof(digits) - digit);
+        std::memcpy(out, digit, length);
+        return out + length;
+    }
+
+    // Longest output of format(): three 64-bit tenths values and two separators
+    static constexpr auto maxFormattedLength = std::size_t{3 * 21 + 2};
+
+    // Writes the summary using the format: <min>/<mean>/<max>, and returns the end of the output
+    inline auto format(char *out) const noexcept -> char *
+    {
+        out = formatTenths(out, _min);
+        *out++ = '/';
+        out = formatTenths(out, meanTenths());
+        *out++ = '/';
+        return formatTenths(out, _max);
+    }
+
+    friend auto operator<<(std::ostream &os, const BasicMeasurements &measurements) noexcept -> std::ostream &
+    {
+        char buffer[maxFormattedLength];
+        return os.write(buffer, measurements.format(buffer) - buffer);
+    }
+
+private:
+    // Measurements are at most 99.9 in magnitude, so the sentinels make the first record() set min and max
+    std::int64_t _sum = 0;
+    CountType _count = 0;
+    std::int16_t _min = std::numeric_limits<std::int16_t>::max();
+    std::int16_t _max = std::numeric_limits<std::int16_t>::min();
+};
+
+using CompactMeasurements = BasicMeasurements<std::uint32_t>;
+using WideMeasurements = BasicMeasurements<std::uint64_t>;
+
+static_assert(sizeof(CompactMeasurements) == 16, "two compact stations must fit in a cache line");
+
+// Exact distribution of one station: one counter per tenth in [-99.9, 99.9], so record() is a single
+// increment and percentiles and the standard deviation come out exact. The counters are 16 bits wide,
+// 4 KiB per station allocated on its first row, and the rare carries out of a counter go to a second
+// array that only exists once a counter wraps. Min, max, sum and count are derived from the counters.
+class HistogramMeasurements
+{
+public:
+    using ValType = std::int32_t;
+
+    static constexpr auto lowest = -999;
+    static constexpr auto bins = std::size_t{1999};
+
+private:
+    std::unique_ptr<std::uint16_t[]> _low;
+    std::unique_ptr<std::uint32_t[]> _high;
+
+    auto allocate()
+    {
+        _low.reset(new std::uint16_t[bins]());
+    }
+
+    auto carry(std::size_t bin)
+    {
+        if (_high == nullptr)
+        {
+            _high.reset(new std::uint32_t[bins]());
+        }
+        _high[bin]++;
+    }
+
+    inline auto count(std::size_t bin) const noexcept
+    {
+        return _low[bin] + (_high != nullptr ? std::uint64_t{_high[bin]} << 16 : 0);
+    }
+
+    // Value in tenths of the first bin whose running count reaches rank
+    auto rankTenths(std::uint64_t rank) const noexcept -> std::int64_t
+    {
+        auto seen = std::uint64_t{0};
+        for (auto bin = std::size_t{0}; bin < bins; bin++)
+        {
+            seen += count(bin);
+            if (seen >= rank)
+            {
+                return static_cast<std::int64_t>(bin) + lowest;
+            }
+        }
+        return static_cast<std::int64_t>(bins) - 1 + lowest;
+    }
+
+public:
+    inline auto record(ValType measurement)
+    {
+        if (__builtin_expect(_low == nullptr, 0))
+        {
+            allocate();
+        }
+
+        auto bin = static_cast<std::size_t>(measurement - lowest);
+        if (__builtin_expect(++_low[bin] == 0, 0))
+        {
+            carry(bin);
+        }
+    }
+
+    // Adds the counters of the other station, a plain vectorized add unless a counter wraps
+    auto merge(const HistogramMeasurements &measurements)
+    {
+        if (measurements._low == nullptr)
+        {
+            return;
+        }
+        if (_low == nullptr)
+        {
+            allocate();
+        }
+
+        auto wrapped = false;
+        for (auto bin = std::size_t{0}; bin < bins; bin++)
+        {
+            auto total = std::uint32_t{_low[bin]} + measurements._low[bin];
+            _low[bin] = static_cast<std::uint16_t>(total);
+            wrapped |= total > 0xffff;
+        }
+        if (wrapped)
+        {
+            for (auto bin = std::size_t{0}; bin < bins; bin++)
+            {
+                if (_low[bin] < measurements._low[bin])
+                {
+                    carry(bin);
+                }
+            }
+        }
+
+        if (measurements._high != nullptr)
+        {
+            if (_high == nullptr)
+            {
+                _high.reset(new std::uint32_t[bins]());
+            }
+            for (auto bin = std::size_t{0}; bin < bins; bin++)
+            {
+                _high[bin] += measurements._high[bin];
+            }
+        }
+    }
+
+    auto state() const noexcept
+    {
+        auto state = MeasurementsState{0, 0, std::numeric_limits<std::int16_t>::max(), std::numeric_limits<std::int16_t>::min()};
+        for (auto bin = std::size_t{0}; _low != nullptr && bin < bins; bin++)
+        {
+            auto rows = count(bin);
+            if (rows != 0)
+            {
+                auto tenths = static_cast<std::int16_t>(static_cast<int>(bin) + lowest);
+                state.sum += static_cast<std::int64_t>(rows) * tenths;
+                state.count += rows;
+                state.min = std::min(state.min, tenths);
+                state.max = std::max(state.max, tenths);
+            }
+        }
+        return state;
+    }
+
+    auto count() const noexcept
+    {
+        return _low != nullptr ? state().count : 0;
+    }
+
+    // Nearest-rank percentile in tenths, the smallest value with at least p percent of the rows at or below it
+    auto percentileTenths(double p, std::uint64_t count) const noexcept
+    {
+        auto rank = static_cast<std::uint64_t>(std::ceil(p / 100.0 * static_cast<double>(count)));
+        return rankTenths(std::max<std::uint64_t>(rank, 1));
+    }
+
+    // Population standard deviation in tenths
+    auto stddevTenths(const MeasurementsState &state) const noexcept
+    {
+        auto mean = static_cast<double>(state.sum) / static_cast<double>(state.count);
+        auto squares = 0.0;
+        for (auto bin = std::size_t{0}; bin < bins; bin++)
+        {
+            auto deviation = static_cast<double>(static_cast<int>(bin) + lowest) - mean;
+            squares += static_cast<double>(count(bin)) * deviation * deviation;
+        }
+        return std::sqrt(squares / static_cast<double>(state.count));
+    }
+
+    // Longest output of format(): seven 64-bit tenths values and six separators
+    static constexpr auto maxFormattedLength = std::size_t{7 * 21 + 6};
+
+    // Writes the summary using the format: <min>/<mean>/<max>/<p50>/<p95>/<p99>/<stddev>, and returns the
+    // end of the output
+    auto format(char *out) const noexcept -> char *
+    {
+        auto state = this->state();
+        auto summary = WideMeasurements::fromState(state);
+        out = summary.format(out);
+        for (auto p : {50.0, 95.0, 99.0})
+        {
+            *out++ = '/';
+            out = WideMeasurements::formatTenths(out, percentileTenths(p, state.count));
+        }
+        *out++ = '/';
+        return WideMeasurements::formatTenths(out, std::llround(stddevTenths(state)));
+    }
+};
+
+// Shortest possible line "a;0.0\n", bounds the number of rows an input of a given size can hold
+static constexpr auto minLineLength = std::uintmax_t{6};
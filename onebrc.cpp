@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <mutex>
+#include <system_error>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "onebrc.hpp"
+#include "arena.hpp"
+#include "measurements.hpp"
+#include "station_table.hpp"
+#include "mapped_file.hpp"
+#include "scan.hpp"
+
+struct Aggregation::Stations
+{
+    Arena names;
+    std::vector<StationSummary> stations;
+    std::uint64_t rows = 0;
+    std::once_flag sorted;
+
+    auto sort() -> std::vector<StationSummary> &
+    {
+        std::call_once(sorted, [this]
+                       { std::sort(stations.begin(), stations.end(), [](const auto &a, const auto &b)
+                                   { return a.name < b.name; }); });
+        return stations;
+    }
+};
+
+auto StationSummary::meanTenths() const noexcept -> std::int64_t
+{
+    return WideMeasurements::fromState({sum, count, min, max}).meanTenths();
+}
+
+Aggregation::Aggregation(std::unique_ptr<Stations> stations) noexcept : _stations{std::move(stations)}
+{
+}
+
+Aggregation::Aggregation(Aggregation &&) noexcept = default;
+Aggregation &Aggregation::operator=(Aggregation &&) noexcept = default;
+Aggregation::~Aggregation() = default;
+
+auto Aggregation::begin() const -> const_iterator
+{
+    return _stations->sort().cbegin();
+}
+
+auto Aggregation::end() const -> const_iterator
+{
+    return _stations->sort().cend();
+}
+
+auto Aggregation::size() const noexcept -> std::size_t
+{
+    return _stations->stations.size();
+}
+
+auto Aggregation::rows() const noexcept -> std::uint64_t
+{
+    return _stations->rows;
+}
+
+auto Aggregation::find(std::string_view name) const -> const StationSummary *
+{
+    const auto &stations = _stations->sort();
+    auto it = std::lower_bound(stations.begin(), stations.end(), name, [](const auto &station, std::string_view name)
+                               { return station.name < name; });
+    return it != stations.end() && it->name == name ? &*it : nullptr;
+}
+
+auto Aggregation::text() const -> std::string
+{
+    const auto &stations = _stations->sort();
+    auto text = std::string{"{"};
+    char buffer[WideMeasurements::maxFormattedLength];
+    for (auto it = stations.begin(); it != stations.end(); it++)
+    {
+        text.append(it->name);
+        text.push_back('=');
+        auto measurements = WideMeasurements::fromState({it->sum, it->count, it->min, it->max});
+        text.append(buffer, measurements.format(buffer));
+        if (it + 1 != stations.end())
+        {
+            text.append(", ");
+        }
+    }
+    text.push_back('}');
+    return text;
+}
+
+// Scans the range with one placed thread per CPU and copies the merged stations out, names into the arena
+template <typename Measurements>
+auto aggregateRange(const char *data, std::size_t size, const AggregationOptions &options,
+                    Arena &names, std::vector<StationSummary> &summaries, std::uint64_t &rows)
+{
+    using Map = MapType<Measurements>;
+
+    auto placement = ThreadPlacement{options.threads, options.smt};
+    auto threadStats = std::vector<ThreadStats>{placement.threads()};
+    auto scheduler = SegmentScheduler{0, size, std::max<std::size_t>(1, options.segmentSize), placement.nodeThreads()};
+    auto stationMaps = runPlaced<Map>(placement, threadStats, [&](unsigned i, Map &stations, ThreadStats &stats)
+                                      { processMapped(data, scheduler, placement.node(i), stations, stats); });
+    mergeTables(stationMaps);
+
+    for (const auto &[name, measurements] : stationMaps.front())
+    {
+        auto state = measurements.state();
+        summaries.push_back({names.copy(name), state.min, state.max, state.sum, state.count});
+        rows += state.count;
+    }
+}
+
+auto aggregate(const char *data, std::size_t size, const AggregationOptions &options) -> Aggregation
+{
+    auto stations = std::make_unique<Aggregation::Stations>();
+
+    // Keep the compact 16-byte accumulators unless the range could hold 2^32 rows or more
+    if (size / minLineLength >= std::numeric_limits<std::uint32_t>::max())
+    {
+        aggregateRange<WideMeasurements>(data, size, options, stations->names, stations->stations, stations->rows);
+    }
+    else
+    {
+        aggregateRange<CompactMeasurements>(data, size, options, stations->names, stations->stations, stations->rows);
+    }
+    return Aggregation{std::move(stations)};
+}
+
+auto aggregate(int fd, const AggregationOptions &options) -> Aggregation
+{
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        throw std::system_error{errno, std::generic_category(), "fstat"};
+    }
+
+    if (S_ISREG(st.st_mode))
+    {
+        auto file = MappedFile{fd, "aggregate"};
+        return aggregate(file.data(), file.size(), options);
+    }
+
+    auto input = std::vector<char>(std::size_t{1} << 20);
+    auto size = std::size_t{0};
+    for (;;)
+    {
+        if (size == input.size())
+        {
+            input.resize(2 * input.size());
+        }
+
+        auto count = ::read(fd, input.data() + size, input.size() - size);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error{errno, std::generic_category(), "read"};
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        size += static_cast<std::size_t>(count);
+    }
+    return aggregate(input.data(), size, options);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// In-process interface of lib1brc: aggregates measurements text (<station>;<measurement>\n lines) with the
+// same partitioned, pinned scan as calculate_average and returns the stations instead of printing them.
+// Errors are thrown as std::system_error.
+
+struct AggregationOptions
+{
+    unsigned threads = 0; // 0 uses every CPU the process may run on
+    bool smt = true;      // false keeps one hardware thread per core
+    std::size_t segmentSize = std::size_t{8} << 20;
+};
+
+// Aggregate of one station, temperatures in integer tenths of a degree
+struct StationSummary
+{
+    std::string_view name;
+    std::int16_t min;
+    std::int16_t max;
+    std::int64_t sum;
+    std::uint64_t count;
+
+    // Mean in tenths, rounded half up like the text output
+    auto meanTenths() const noexcept -> std::int64_t;
+
+    auto mean() const noexcept
+    {
+        return static_cast<double>(sum) / static_cast<double>(count) / 10.0;
+    }
+};
+
+// Stations of an aggregation. They are sorted by name the first time they are iterated, looked up or
+// printed, so a caller that only needs a few of them or the row count never pays for the sort.
+class Aggregation
+{
+public:
+    using const_iterator = std::vector<StationSummary>::const_iterator;
+
+    Aggregation(Aggregation &&) noexcept;
+    Aggregation &operator=(Aggregation &&) noexcept;
+    ~Aggregation();
+
+    auto begin() const -> const_iterator;
+    auto end() const -> const_iterator;
+    auto size() const noexcept -> std::size_t;
+
+    // Rows aggregated, the sum of the station counts
+    auto rows() const noexcept -> std::uint64_t;
+
+    // The station with the name, nullptr if it did not occur
+    auto find(std::string_view name) const -> const StationSummary *;
+
+    // The result in the format of calculate_average: {<station>=<min>/<mean>/<max>, ...}
+    auto text() const -> std::string;
+
+private:
+    struct Stations;
+    std::unique_ptr<Stations> _stations;
+
+    explicit Aggregation(std::unique_ptr<Stations> stations) noexcept;
+
+    friend auto aggregate(const char *data, std::size_t size, const AggregationOptions &options) -> Aggregation;
+    friend auto aggregate(int fd, const AggregationOptions &options) -> Aggregation;
+};
+
+// Aggregates the complete lines in [data, data + size)
+auto aggregate(const char *data, std::size_t size, const AggregationOptions &options = {}) -> Aggregation;
+
+// Aggregates the whole file open on fd. Regular files are mapped, pipes and other descriptors are read to
+// their end first. The descriptor stays open.
+auto aggregate(int fd, const AggregationOptions &options = {}) -> Aggregation;
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Bit masks of the ';' and '\n' delimiters inside a 64 byte block, bit i is set for byte i
+struct DelimiterMasks
+{
+    std::uint64_t semicolons;
+    std::uint64_t newlines;
+};
+
+static constexpr auto blockSize = 64;
+
+#if defined(__AVX2__) && !defined(ONEBRC_SWAR)
+
+inline auto scanBlock(const char *block) noexcept -> DelimiterMasks
+{
+    auto semicolon = _mm256_set1_epi8(';');
+    auto newline = _mm256_set1_epi8('\n');
+    auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+    auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32));
+
+    auto mask = [](__m256i v, __m256i c)
+    {
+        return static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, c))));
+    };
+
+    return {mask(lo, semicolon) | mask(hi, semicolon) << 32,
+            mask(lo, newline) | mask(hi, newline) << 32};
+}
+
+#elif defined(__SSE2__) && !defined(ONEBRC_SWAR)
+
+inline auto scanBlock(const char *block) noexcept -> DelimiterMasks
+{
+    auto semicolon = _mm_set1_epi8(';');
+    auto newline = _mm_set1_epi8('\n');
+    auto masks = DelimiterMasks{0, 0};
+
+    for (auto i = 0; i < blockSize; i += 16)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i));
+        masks.semicolons |= static_cast<std::uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, semicolon))) << i;
+        masks.newlines |= static_cast<std::uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline))) << i;
+    }
+
+    return masks;
+}
+
+#else
+
+// Portable fallback processing 8 bytes per 64-bit word
+inline auto swarMask(std::uint64_t word, std::uint64_t pattern) noexcept -> std::uint64_t
+{
+    constexpr auto low7 = std::uint64_t{0x7F7F7F7F7F7F7F7F};
+
+    // Set the high bit of every byte equal to the pattern byte (exact, no false positives)
+    auto x = word ^ pattern;
+    auto zero = ~(((x & low7) + low7) | x | low7);
+
+    // Gather the high bits of the 8 bytes into the low 8 bits
+    return (zero * std::uint64_t{0x0002040810204081}) >> 56;
+}
+
+inline auto scanBlock(const char *block) noexcept -> DelimiterMasks
+{
+    constexpr auto semicolon = std::uint64_t{0x3B3B3B3B3B3B3B3B};
+    constexpr auto newline = std::uint64_t{0x0A0A0A0A0A0A0A0A};
+    auto masks = DelimiterMasks{0, 0};
+
+    for (auto i = 0; i < blockSize; i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, block + i, sizeof(word));
+        masks.semicolons |= swarMask(word, semicolon) << i;
+        masks.newlines |= swarMask(word, newline) << i;
+    }
+
+    return masks;
+}
+
+#endif
+
+// Decodes a measurement of the form -?\d?\d\.\d into integer tenths without branches or loops.
+// The input is loaded as one little-endian word: the '.' is the only byte among the first four
+// with bit 4 clear after the optional sign, which gives its position and so the number of digits.
+inline auto decodeMeasurement(std::uint64_t word) noexcept -> std::int32_t
+{
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "decodeMeasurement expects a little-endian word");
+
+    // Bit index of the '.' byte (12, 20 or 28)
+    auto dot = __builtin_ctzll(~word & 0x10101000);
+
+    // All ones when the first byte is '-', zero otherwise
+    auto sign = static_cast<std::int64_t>(~word << 59) >> 63;
+
+    // Drop the sign, then align the digits so that they land on bytes 1, 2 and 4
+    auto digits = ((word & ~(sign & 0xFF)) << (28 - dot)) & 0x0F000F0F00;
+
+    // Multiply-add the digits as 100 * a + 10 * b + c in the bits 32..41
+    auto value = static_cast<std::int64_t>(((digits * 0x640a0001) >> 32) & 0x3FF);
+
+    return static_cast<std::int32_t>((value ^ sign) - sign);
+}
+
+// Decodes the measurement starting at first without reading at or past end
+inline auto decodeMeasurement(const char *first, const char *end) noexcept -> std::int32_t
+{
+    auto word = std::uint64_t{0};
+    if (end - first >= static_cast<std::ptrdiff_t>(sizeof(word)))
+    {
+        std::memcpy(&word, first, sizeof(word));
+    }
+    else
+    {
+        std::memcpy(&word, first, static_cast<std::size_t>(end - first));
+    }
+
+    return decodeMeasurement(word);
+}
+
+class Parser
+{
+    std::uint64_t _rows = 0;
+
+public:
+    // Complete lines parsed so far
+    constexpr auto rows() const noexcept
+    {
+        return _rows;
+    }
+
+    // Parses every complete line in [begin, end) and returns the start of the trailing incomplete line
+    template <typename Map>
+    auto operator()(const char *begin, const char *end, Map &stations) -> const char *
+    {
+        auto line = begin;
+        auto semicolon = begin;
+
+        for (auto block = begin; block < end; block += blockSize)
+        {
+            DelimiterMasks masks;
+            if (end - block >= blockSize)
+            {
+                masks = scanBlock(block);
+            }
+            else
+            {
+                // Never load past the end of the range, the zero padding contains no delimiters
+                char tail[blockSize] = {};
+                std::memcpy(tail, block, static_cast<std::size_t>(end - block));
+                masks = scanBlock(tail);
+            }
+            _rows += static_cast<std::uint64_t>(__builtin_popcountll(masks.newlines));
+
+            // Every line has exactly one ';' before its '\n', so the highest ';' below a '\n' belongs to its line
+            auto handled = std::uint64_t{0};
+            for (auto newlines = masks.newlines; newlines != 0; newlines &= newlines - 1)
+            {
+                auto bit = newlines & (~newlines + 1);
+                auto before = masks.semicolons & (bit - 1);
+                if (before != 0)
+                {
+                    semicolon = block + 63 - __builtin_clzll(before);
+                }
+
+                auto newline = block + __builtin_ctzll(newlines);
+                auto station = std::string_view{line, static_cast<std::size_t>(semicolon - line)};
+                auto hash = Map::hasher::hash(station.data(), station.size(), end);
+                stations.get(station, hash).record(decodeMeasurement(semicolon + 1, end));
+
+                line = newline + 1;
+                handled = bit | (bit - 1);
+            }
+
+            // Carry the ';' of a line that continues in the next block
+            auto pending = masks.semicolons & ~handled;
+            if (pending != 0)
+            {
+                semicolon = block + 63 - __builtin_clzll(pending);
+            }
+        }
+
+        return line;
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware counters of the calling thread and of every thread it starts afterwards (inherit),
+// counted in user space only so that the default perf_event_paranoid setting allows them.
+// Counters the kernel or the hardware does not support are simply reported as unavailable.
+class PerfCounters
+{
+public:
+    enum Event
+    {
+        Cycles,
+        Instructions,
+        BranchMisses,
+        LastLevelCacheMisses,
+        EventCount
+    };
+
+    static constexpr const char *names[EventCount] = {"cycles", "instructions", "branch-misses", "LLC-misses"};
+
+private:
+    std::array<int, EventCount> _fds;
+    int _error = 0;
+
+    static auto open(std::uint32_t type, std::uint64_t config) noexcept
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+public:
+    PerfCounters() noexcept
+    {
+        _fds[Cycles] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        _fds[Instructions] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        _fds[BranchMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        _fds[LastLevelCacheMisses] = open(PERF_TYPE_HW_CACHE,
+                                          PERF_COUNT_HW_CACHE_LL |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+        if (_fds[Cycles] < 0)
+        {
+            _error = errno;
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters()
+    {
+        for (auto fd : _fds)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    }
+
+    // errno of the failed cycles counter, 0 when it is available
+    auto error() const noexcept
+    {
+        return _error;
+    }
+
+    auto enable() noexcept
+    {
+        for (auto fd : _fds)
+        {
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    auto disable() noexcept
+    {
+        for (auto fd : _fds)
+        {
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+    }
+
+    // Reads the event, including the threads that already exited, returns false if it is unavailable
+    auto read(Event event, std::uint64_t &value) const noexcept
+    {
+        return _fds[event] >= 0 && ::read(_fds[event], &value, sizeof(value)) == sizeof(value);
+    }
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+// Parses a sysfs CPU or node list such as "0-3,8-11"
+inline auto parseSysfsList(const std::string &text)
+{
+    auto values = std::vector<int>{};
+    for (std::size_t position = 0; position < text.size();)
+    {
+        auto comma = std::min(text.find(',', position), text.size());
+        auto range = text.substr(position, comma - position);
+        auto dash = range.find('-');
+        try
+        {
+            auto first = std::stoi(range.substr(0, dash));
+            auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (auto value = first; value <= last; value++)
+            {
+                values.push_back(value);
+            }
+        }
+        catch (std::exception &)
+        {
+            // Ignore empty or malformed entries
+        }
+        position = comma + 1;
+    }
+    return values;
+}
+
+inline auto readSysfs(const std::string &path)
+{
+    auto text = std::string{};
+    std::getline(std::ifstream{path}, text);
+    return text;
+}
+
+// Which CPU and NUMA node every scan thread runs on. Nodes and SMT siblings come from sysfs, restricted
+// to the CPUs the process may run on, and the threads are dealt to the nodes in turn so that every node
+// gets its share. Without sysfs all allowed CPUs form a single node.
+class ThreadPlacement
+{
+    struct Slot
+    {
+        int cpu;
+        unsigned node; // dense index among the nodes in use
+    };
+
+    std::vector<Slot> _slots;
+    std::vector<unsigned> _nodeThreads;
+
+public:
+    // threads == 0 uses one thread per selected CPU, smt == false keeps one CPU per physical core
+    ThreadPlacement(unsigned threads, bool smt)
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            for (auto cpu = 0; cpu < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); cpu++)
+            {
+                CPU_SET(cpu, &allowed);
+            }
+        }
+
+        auto usable = [&](int cpu)
+        {
+            if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+            {
+                return false;
+            }
+
+            // The first CPU of a core stands for the core
+            auto siblings = parseSysfsList(readSysfs("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+            return smt || siblings.empty() || *std::min_element(siblings.begin(), siblings.end()) == cpu;
+        };
+
+        auto nodes = std::vector<std::vector<int>>{};
+        for (auto node : parseSysfsList(readSysfs("/sys/devices/system/node/online")))
+        {
+            auto cpus = parseSysfsList(readSysfs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu)
+                                      { return !usable(cpu); }),
+                       cpus.end());
+            if (!cpus.empty())
+            {
+                nodes.push_back(cpus);
+            }
+        }
+
+        if (nodes.empty())
+        {
+            nodes.emplace_back();
+            for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (usable(cpu))
+                {
+                    nodes.back().push_back(cpu);
+                }
+            }
+            if (nodes.back().empty())
+            {
+                nodes.back().push_back(-1);
+            }
+        }
+
+        auto cpuCount = std::size_t{0};
+        for (const auto &cpus : nodes)
+        {
+            cpuCount += cpus.size();
+        }
+        if (threads == 0)
+        {
+            threads = static_cast<unsigned>(cpuCount);
+        }
+
+        // Deal the CPUs to the threads one node at a time, more threads than CPUs share them in the same order
+        for (auto round = std::size_t{0}; _slots.size() < std::min<std::size_t>(threads, cpuCount); round++)
+        {
+            for (auto node = 0u; node < nodes.size() && _slots.size() < threads; node++)
+            {
+                if (round < nodes[node].size())
+                {
+                    _slots.push_back({nodes[node][round], node});
+                }
+            }
+        }
+        while (_slots.size() < threads)
+        {
+            _slots.push_back(_slots[_slots.size() - cpuCount]);
+        }
+
+        _nodeThreads.assign(nodes.size(), 0);
+        for (const auto &slot : _slots)
+        {
+            _nodeThreads[slot.node]++;
+        }
+    }
+
+    inline auto threads() const noexcept
+    {
+        return static_cast<unsigned>(_slots.size());
+    }
+
+    inline auto node(unsigned thread) const noexcept
+    {
+        return _slots[thread].node;
+    }
+
+    // Threads per node, the scan splits the input in proportion
+    inline auto nodeThreads() const noexcept -> const std::vector<unsigned> &
+    {
+        return _nodeThreads;
+    }
+
+    inline auto cpu(unsigned thread) const noexcept
+    {
+        return _slots[thread].cpu;
+    }
+
+    // Pins the calling thread to the CPU of the slot, memory it touches first is then allocated on its node
+    auto pin(unsigned thread) const noexcept
+    {
+        if (_slots[thread].cpu < 0)
+        {
+            return;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(_slots[thread].cpu, &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    }
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "parser.hpp"
+#include "placement.hpp"
+#include "shared_table.hpp"
+#include "station_table.hpp"
+
+static constexpr auto defaultSegmentSize = std::size_t{8} << 20;
+
+// Hands out fixed-size segments of the byte range [first, last) of the input from shared cursors, so a
+// thread that falls behind simply takes fewer segments. Segment boundaries are nominal byte offsets, each
+// reader moves them after the next '\n' so consecutive segments stay contiguous. The range itself must
+// start at the beginning of a line.
+// The segments are split into contiguous partitions in proportion to their weights, one per NUMA node:
+// a thread takes segments of its own partition first and helps with the others once it is exhausted.
+class SegmentScheduler
+{
+    struct alignas(64) Cursor
+    {
+        std::atomic<std::size_t> next{0};
+        std::size_t start = 0;
+        std::size_t end = 0;
+    };
+
+    std::vector<Cursor> _cursors;
+    std::size_t _first;
+    std::size_t _last;
+    std::size_t _segmentSize;
+
+public:
+    SegmentScheduler(std::size_t first, std::size_t last, std::size_t segmentSize, const std::vector<unsigned> &weights = {1})
+        : _cursors(std::max<std::size_t>(1, weights.size())), _first{std::min(first, last)}, _last{last}, _segmentSize{segmentSize}
+    {
+        auto segments = (_last - _first + _segmentSize - 1) / _segmentSize;
+        auto total = std::max(1u, std::accumulate(weights.begin(), weights.end(), 0u));
+        auto weight = 0u;
+        for (auto i = std::size_t{0}; i < _cursors.size(); i++)
+        {
+            _cursors[i].start = segments * weight / total;
+            _cursors[i].next = _cursors[i].start;
+            weight += i < weights.size() ? weights[i] : 0;
+            _cursors[i].end = i + 1 < _cursors.size() ? segments * weight / total : segments;
+        }
+    }
+
+    constexpr auto first() const noexcept
+    {
+        return _first;
+    }
+
+    constexpr auto last() const noexcept
+    {
+        return _last;
+    }
+
+    // Hands out the whole range again, for a rescan after the threads are done
+    auto rewind() noexcept
+    {
+        for (auto &cursor : _cursors)
+        {
+            cursor.next = cursor.start;
+        }
+    }
+
+    // Claims the next segment [start, end), returns false when the whole range was handed out
+    inline auto next(std::size_t &start, std::size_t &end, unsigned partition = 0) noexcept
+    {
+        for (auto i = std::size_t{0}; i < _cursors.size(); i++)
+        {
+            auto &cursor = _cursors[(partition + i) % _cursors.size()];
+            if (cursor.next.load(std::memory_order_relaxed) >= cursor.end)
+            {
+                continue;
+            }
+
+            auto index = cursor.next.fetch_add(1, std::memory_order_relaxed);
+            if (index < cursor.end)
+            {
+                start = _first + index * _segmentSize;
+                end = std::min(start + _segmentSize, _last);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Filled by the scan threads, only read with --stats
+struct ThreadStats
+{
+    std::size_t segments = 0;
+    std::size_t bytes = 0;
+    std::uint64_t rows = 0;
+    std::chrono::steady_clock::duration elapsed{};
+    std::chrono::steady_clock::duration boundarySearch{};
+    int error = 0; // errno of a failed read, readers that throw report errors on the calling thread instead
+};
+
+// Parses the segment [start, end) of the input [first, last) at begin, after moving both boundaries
+// after the first '\n' at or after them - 1 so that consecutive segments stay contiguous
+template <typename Map>
+auto parseSegment(const char *begin, std::size_t first, std::size_t last, std::size_t start, std::size_t end,
+                  Parser &parser, Map &stations, ThreadStats &stats) noexcept
+{
+    auto align = [&](std::size_t offset)
+    {
+        if (offset <= first || offset >= last)
+        {
+            return offset;
+        }
+
+        auto newline = static_cast<const char *>(std::memchr(begin + offset - 1, '\n', last - offset + 1));
+        return newline != nullptr ? static_cast<std::size_t>(newline - begin) + 1 : last;
+    };
+
+    auto alignStart = std::chrono::steady_clock::now();
+    start = align(start);
+    end = align(end);
+    stats.boundarySearch += std::chrono::steady_clock::now() - alignStart;
+
+    // Parse the lines directly from the mapped pages using the format: <station>;<measurement>\n
+    if (start < end)
+    {
+        parser(begin + start, begin + end, stations);
+        stats.bytes += end - start;
+    }
+    stats.segments++;
+}
+
+// Parses the segments of [first, last) of the input at begin, e.g. a mapped file
+template <typename Map>
+auto processMapped(const char *begin, SegmentScheduler &scheduler, unsigned partition, Map &stations, ThreadStats &stats) noexcept
+{
+    auto threadStart = std::chrono::steady_clock::now();
+    auto parser = Parser{};
+    for (std::size_t start, end; scheduler.next(start, end, partition);)
+    {
+        parseSegment(begin, scheduler.first(), scheduler.last(), start, end, parser, stations, stats);
+    }
+    stats.rows = parser.rows();
+    stats.elapsed = std::chrono::steady_clock::now() - threadStart;
+}
+
+// Segment [start, end) of one of several inputs
+struct InputSegment
+{
+    std::size_t input;
+    std::size_t start;
+    std::size_t end;
+};
+
+// Splits every input into segments of at most segmentSize bytes, a small input makes a single segment
+inline auto splitInputs(const std::vector<std::string_view> &inputs, std::size_t segmentSize)
+{
+    auto segments = std::vector<InputSegment>{};
+    for (auto input = std::size_t{0}; input < inputs.size(); input++)
+    {
+        for (auto start = std::size_t{0}; start < inputs[input].size(); start += segmentSize)
+        {
+            segments.push_back({input, start, std::min(start + segmentSize, inputs[input].size())});
+        }
+    }
+    return segments;
+}
+
+// Parses the segments of several inputs with one thread pool. The scheduler hands out segment indexes
+// (a segment size of 1), so a thread moves on to the next input as soon as one is exhausted.
+template <typename Map>
+auto processInputs(const std::vector<std::string_view> &inputs, const std::vector<InputSegment> &segments,
+                   SegmentScheduler &scheduler, unsigned partition, Map &stations, ThreadStats &stats) noexcept
+{
+    auto threadStart = std::chrono::steady_clock::now();
+    auto parser = Parser{};
+    for (std::size_t index, end; scheduler.next(index, end, partition);)
+    {
+        const auto &segment = segments[index];
+        const auto &input = inputs[segment.input];
+        parseSegment(input.data(), 0, input.size(), segment.start, segment.end, parser, stations, stats);
+    }
+    stats.rows = parser.rows();
+    stats.elapsed = std::chrono::steady_clock::now() - threadStart;
+}
+
+// Merges the per-thread tables pairwise in log2(n) parallel rounds, leaving the result in the first table
+template <typename Map>
+auto mergeTables(std::vector<Map> &tables)
+{
+    for (auto stride = std::size_t{1}; stride < tables.size(); stride *= 2)
+    {
+        auto threads = std::vector<std::thread>{};
+        for (auto i = 2 * stride; i + stride < tables.size(); i += 2 * stride)
+        {
+            threads.push_back(std::thread{[&tables, i, stride]
+                                          { tables[i].merge(tables[i + stride]); }});
+        }
+
+        // The first pair of the round is merged on the calling thread
+        tables[0].merge(tables[stride]);
+
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+// Sorts the station names without copying them out of the table
+template <typename Map>
+auto sortedKeys(const Map &stations)
+{
+    auto keys = std::vector<std::string_view>{};
+    keys.reserve(stations.size());
+    for (const auto &[key, measurements] : stations)
+    {
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+// Runs body(thread, stations, stats) on every placed thread and returns their station tables, built from
+// arguments. Each thread pins itself before it builds its table and buffers, so their pages are first
+// touched, and allocated, on the node it runs on. Moving the tables out afterwards keeps their storage
+// where it is.
+template <typename Map, typename Body, typename... Arguments>
+auto runPlaced(const ThreadPlacement &placement, std::vector<ThreadStats> &threadStats, Body body, const Arguments &...arguments) -> std::vector<Map>
+{
+    auto placed = std::vector<std::optional<Map>>(placement.threads());
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0u; i < placement.threads(); i++)
+    {
+        threads.push_back(std::thread{[&, i]
+                                      {
+                                          placement.pin(i);
+                                          body(i, placed[i].emplace(arguments...), threadStats[i]);
+                                      }});
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    auto stationMaps = std::vector<Map>{};
+    stationMaps.reserve(placed.size());
+    for (auto &stations : placed)
+    {
+        stationMaps.push_back(std::move(*stations));
+    }
+    return stationMaps;
+}
+
+// Runs body(thread, table, stats) on every placed thread against one shared table of the capacity and
+// copies its stations into a single Map for the usual merge and output. Returns nothing if the table
+// filled up before the scan was done. With probes, it also receives the probe lengths of the shared table.
+template <typename Map, typename Body>
+auto runShared(const ThreadPlacement &placement, std::vector<ThreadStats> &threadStats, Body body, std::size_t capacity,
+               ProbeStats *probes = nullptr) -> std::optional<std::vector<Map>>
+{
+    auto table = SharedStationTable<typename Map::hasher>{capacity};
+    auto threads = std::vector<std::thread>{};
+    for (auto i = 0u; i < placement.threads(); i++)
+    {
+        threads.push_back(std::thread{[&, i]
+                                      {
+                                          placement.pin(i);
+                                          body(i, table, threadStats[i]);
+                                      }});
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (table.full())
+    {
+        return std::nullopt;
+    }
+
+    if (probes != nullptr)
+    {
+        *probes = table.probeStats();
+    }
+
+    auto stationMaps = std::vector<Map>(1);
+    table.forEach([&](std::string_view name, const MeasurementsState &state)
+                  { stationMaps.front()[name].merge(Map::mapped_type::fromState(state)); });
+    return stationMaps;
+}
+
+// Distinct stations in a sample of a few windows spread over the inputs, a lower bound of the real count
+inline auto sampleStations(const std::vector<std::string_view> &inputs, std::size_t windows = 8, std::size_t windowSize = std::size_t{1} << 20)
+{
+    auto total = std::size_t{0};
+    for (const auto &input : inputs)
+    {
+        total += input.size();
+    }
+
+    auto stations = StationTable<WordHash, CompactMeasurements>{};
+    auto parser = Parser{};
+    for (auto window = std::size_t{0}; window < windows && total != 0; window++)
+    {
+        // Find the input holding the window's offset, then start after the next '\n'
+        auto offset = total / windows * window;
+        auto input = inputs.begin();
+        while (offset >= input->size())
+        {
+            offset -= input->size();
+            input++;
+        }
+
+        auto begin = input->data() + offset;
+        auto end = input->data() + std::min(input->size(), offset + windowSize);
+        if (offset != 0)
+        {
+            auto newline = static_cast<const char *>(std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+            begin = newline != nullptr ? newline + 1 : end;
+        }
+        parser(begin, end, stations);
+    }
+    return stations.size();
+}
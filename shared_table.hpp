@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <sys/mman.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "measurements.hpp"
+#include "station_table.hpp"
+
+// Measurements of one station recorded by all threads at once. Relaxed atomics are enough because the
+// totals are only read after the threads were joined. There are no initializers, reset() sets the
+// sentinels when a thread claims the slot, so untouched slots of the table stay untouched zero pages.
+class AtomicMeasurements
+{
+    std::atomic<std::int64_t> _sum;
+    std::atomic<std::uint64_t> _count;
+    std::atomic<std::int16_t> _min;
+    std::atomic<std::int16_t> _max;
+
+public:
+    auto reset() noexcept
+    {
+        _sum.store(0, std::memory_order_relaxed);
+        _count.store(0, std::memory_order_relaxed);
+        _min.store(std::numeric_limits<std::int16_t>::max(), std::memory_order_relaxed);
+        _max.store(std::numeric_limits<std::int16_t>::min(), std::memory_order_relaxed);
+    }
+
+    // Two atomic adds, min and max are only written when the measurement extends them
+    inline auto record(std::int32_t measurement) noexcept
+    {
+        _sum.fetch_add(measurement, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+
+        auto value = static_cast<std::int16_t>(measurement);
+        for (auto min = _min.load(std::memory_order_relaxed); value < min && !_min.compare_exchange_weak(min, value, std::memory_order_relaxed);)
+        {
+        }
+        for (auto max = _max.load(std::memory_order_relaxed); value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed);)
+        {
+        }
+    }
+
+    auto state() const noexcept
+    {
+        return MeasurementsState{_sum.load(std::memory_order_relaxed), _count.load(std::memory_order_relaxed),
+                                 _min.load(std::memory_order_relaxed), _max.load(std::memory_order_relaxed)};
+    }
+};
+
+// Fixed-size open-addressing table shared by all scan threads. A thread claims an empty slot for a new
+// station with one compare-and-swap, writes the name and publishes the slot. A thread that meets a slot
+// still being claimed waits for it, since the name decides whether it has to probe further. The table
+// does not grow: past 3/4 of the slots get() returns a spill entry and full() tells the caller to
+// rescan with per-thread tables. The slots are mapped anonymously, so memory is only committed for the
+// pages that stations land on.
+template <typename Hash>
+class SharedStationTable
+{
+    enum : std::uint32_t
+    {
+        Empty,
+        Claimed,
+        Ready
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint32_t> state;
+        std::uint32_t length;
+        std::uint64_t hash;
+        AtomicMeasurements measurements;
+        char name[maxStationLength];
+    };
+
+    Slot *_slots;
+    std::size_t _capacity;
+    std::size_t _mask;
+    alignas(64) std::atomic<std::size_t> _size{0};
+    std::atomic<bool> _full{false};
+    AtomicMeasurements _spill;
+
+public:
+    using hasher = Hash;
+    using mapped_type = AtomicMeasurements;
+
+    // The capacity is rounded up to a power of two
+    explicit SharedStationTable(std::size_t capacity)
+        : _capacity{std::max(std::size_t{2}, std::size_t{1} << (64 - __builtin_clzll(std::max(std::size_t{1}, capacity - 1))))},
+          _mask{_capacity - 1}
+    {
+        auto memory = ::mmap(nullptr, _capacity * sizeof(Slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            throw std::system_error{errno, std::generic_category(), "mmap"};
+        }
+
+        // Zero pages are empty slots, default initialization writes nothing
+        _slots = new (memory) Slot[_capacity];
+        _spill.reset();
+    }
+
+    SharedStationTable(const SharedStationTable &) = delete;
+    SharedStationTable &operator=(const SharedStationTable &) = delete;
+
+    ~SharedStationTable()
+    {
+        ::munmap(_slots, _capacity * sizeof(Slot));
+    }
+
+    inline auto get(std::string_view name, std::uint64_t hash) -> AtomicMeasurements &
+    {
+        if (__builtin_expect(name.size() > maxStationLength, 0))
+        {
+            name = name.substr(0, maxStationLength);
+            hash = static_cast<std::uint64_t>(Hash{}(name));
+        }
+
+        for (auto index = static_cast<std::size_t>(hash) & _mask;; index = (index + 1) & _mask)
+        {
+            auto &slot = _slots[index];
+            auto state = slot.state.load(std::memory_order_acquire);
+            if (state == Empty)
+            {
+                if (_size.load(std::memory_order_relaxed) * 4 >= _capacity * 3)
+                {
+                    _full.store(true, std::memory_order_relaxed);
+                    return _spill;
+                }
+
+                if (slot.state.compare_exchange_strong(state, Claimed, std::memory_order_acquire))
+                {
+                    slot.hash = hash;
+                    slot.length = static_cast<std::uint32_t>(name.size());
+                    std::memcpy(slot.name, name.data(), name.size());
+                    slot.measurements.reset();
+                    _size.fetch_add(1, std::memory_order_relaxed);
+                    slot.state.store(Ready, std::memory_order_release);
+                    return slot.measurements;
+                }
+            }
+
+            // Another thread is writing the name of the slot
+            while (state == Claimed)
+            {
+#if defined(__SSE2__)
+                _mm_pause();
+#endif
+                state = slot.state.load(std::memory_order_acquire);
+            }
+
+            if (slot.hash == hash && slot.length == name.size() && std::memcmp(slot.name, name.data(), name.size()) == 0)
+            {
+                return slot.measurements;
+            }
+        }
+    }
+
+    // Some station found no slot, the result is incomplete
+    inline auto full() const noexcept
+    {
+        return _full.load(std::memory_order_relaxed);
+    }
+
+    // Probe lengths like StationTable::probeStats, once the threads are done
+    auto probeStats() const noexcept
+    {
+        auto stats = ProbeStats{};
+        for (auto index = std::size_t{0}; index < _capacity; index++)
+        {
+            const auto &slot = _slots[index];
+            if (slot.state.load(std::memory_order_acquire) == Ready)
+            {
+                auto probes = ((index - static_cast<std::size_t>(slot.hash)) & _mask) + 1;
+                auto count = slot.measurements.state().count;
+                stats.stations++;
+                stats.displaced += probes > 1;
+                stats.maxProbes = std::max(stats.maxProbes, probes);
+                stats.rows += count;
+                stats.probes += count * probes;
+            }
+        }
+        return stats;
+    }
+
+    // Calls f(name, state) for every station, once the threads are done
+    template <typename F>
+    auto forEach(F f) const
+    {
+        for (auto index = std::size_t{0}; index < _capacity; index++)
+        {
+            const auto &slot = _slots[index];
+            if (slot.state.load(std::memory_order_acquire) == Ready)
+            {
+                f(std::string_view{slot.name, slot.length}, slot.measurements.state());
+            }
+        }
+    }
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "measurements.hpp"
+#include "station_table.hpp"
+
+// Fixed-size summaries of an unbounded set of stations, for inputs with far more stations than the tables
+// are sized for. All of them take the station hash as their only input besides the name, and all of them
+// merge across threads.
+
+// The sketches need uniform bits, while the table hash of a short name comes from a single multiply
+constexpr auto spread(std::uint64_t hash) noexcept
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    return hash ^ (hash >> 33);
+}
+
+// Distinct count estimate from 2^14 registers, about 0.8% standard error in 16 KiB
+class HyperLogLog
+{
+    static constexpr auto indexBits = 14;
+    static constexpr auto registerCount = std::size_t{1} << indexBits;
+
+    std::array<std::uint8_t, registerCount> _registers{};
+
+public:
+    inline auto add(std::uint64_t hash) noexcept
+    {
+        auto index = static_cast<std::size_t>(hash >> (64 - indexBits));
+        auto rank = static_cast<std::uint8_t>(__builtin_clzll((hash << indexBits) | (std::uint64_t{1} << (indexBits - 1))) + 1);
+        _registers[index] = std::max(_registers[index], rank);
+    }
+
+    auto merge(const HyperLogLog &other) noexcept
+    {
+        for (auto i = std::size_t{0}; i < registerCount; i++)
+        {
+            _registers[i] = std::max(_registers[i], other._registers[i]);
+        }
+    }
+
+    // Falls back to linear counting while many registers are still empty
+    auto estimate() const noexcept
+    {
+        auto m = static_cast<double>(registerCount);
+        auto sum = 0.0;
+        auto zeros = 0;
+        for (auto value : _registers)
+        {
+            sum += std::ldexp(1.0, -value);
+            zeros += value == 0;
+        }
+
+        auto estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros != 0)
+        {
+            estimate = m * std::log(m / zeros);
+        }
+        return estimate;
+    }
+};
+
+// Count-min sketch of the rows per station: four rows of 2^14 counters, an estimate never undercounts
+// and overcounts by at most e / 2^14 of all rows with 98% probability
+class CountMin
+{
+    static constexpr auto depth = 4;
+    static constexpr auto widthBits = 14;
+    static constexpr auto width = std::size_t{1} << widthBits;
+
+    std::vector<std::uint64_t> _counters = std::vector<std::uint64_t>(depth * width);
+
+    static inline auto slot(std::uint64_t hash, int row) noexcept
+    {
+        return static_cast<std::size_t>(row) * width + ((hash >> (row * widthBits)) & (width - 1));
+    }
+
+public:
+    inline auto add(std::uint64_t hash) noexcept
+    {
+        for (auto row = 0; row < depth; row++)
+        {
+            _counters[slot(hash, row)]++;
+        }
+    }
+
+    auto estimate(std::uint64_t hash) const noexcept
+    {
+        auto estimate = _counters[slot(hash, 0)];
+        for (auto row = 1; row < depth; row++)
+        {
+            estimate = std::min(estimate, _counters[slot(hash, row)]);
+        }
+        return estimate;
+    }
+
+    auto merge(const CountMin &other) noexcept
+    {
+        for (auto i = std::size_t{0}; i < _counters.size(); i++)
+        {
+            _counters[i] += other._counters[i];
+        }
+    }
+};
+
+// Space-saving heavy hitters: the `capacity` most frequent stations with an upper bound of their rows.
+// A new station replaces the one with the fewest rows and inherits its count as the possible error. The
+// counts never add up to more than the rows and every station that is not kept has at most the smallest
+// count, so every station with more than rows / capacity rows is kept. Both hold across merge(). The
+// entries form a min-heap on the count, found through an open-addressing index on the hash.
+class SpaceSaving
+{
+public:
+    struct Entry
+    {
+        std::uint64_t hash;
+        std::uint64_t count;
+        std::uint64_t error; // rows counted before the station took the slot over
+        std::uint32_t length;
+        char name[maxStationLength];
+
+        inline auto key() const noexcept
+        {
+            return std::string_view{name, length};
+        }
+    };
+
+private:
+    std::vector<Entry> _entries; // heap order, the fewest rows first
+    std::vector<std::uint32_t> _index;
+    std::size_t _capacity;
+    std::size_t _mask;
+
+    static constexpr auto empty = ~std::uint32_t{0};
+
+    inline auto home(std::uint64_t hash) const noexcept
+    {
+        return static_cast<std::size_t>(hash) & _mask;
+    }
+
+    // Index slot of the entry with the name, or the empty slot where it would go
+    inline auto find(std::string_view name, std::uint64_t hash) const noexcept
+    {
+        auto slot = home(hash);
+        while (_index[slot] != empty)
+        {
+            const auto &entry = _entries[_index[slot]];
+            if (entry.hash == hash && entry.key() == name)
+            {
+                break;
+            }
+            slot = (slot + 1) & _mask;
+        }
+        return slot;
+    }
+
+    inline auto slotOf(std::size_t position) const noexcept
+    {
+        auto slot = home(_entries[position].hash);
+        while (_index[slot] != position)
+        {
+            slot = (slot + 1) & _mask;
+        }
+        return slot;
+    }
+
+    // Deletes from the index by shifting the following entries of the probe run back
+    auto erase(std::size_t slot) noexcept
+    {
+        for (auto next = (slot + 1) & _mask; _index[next] != empty; next = (next + 1) & _mask)
+        {
+            auto wanted = home(_entries[_index[next]].hash);
+            if (((next - wanted) & _mask) >= ((next - slot) & _mask))
+            {
+                _index[slot] = _index[next];
+                slot = next;
+            }
+        }
+        _index[slot] = empty;
+    }
+
+    auto swap(std::size_t a, std::size_t b) noexcept
+    {
+        auto slotA = slotOf(a);
+        auto slotB = slotOf(b);
+        std::swap(_entries[a], _entries[b]);
+        _index[slotA] = static_cast<std::uint32_t>(b);
+        _index[slotB] = static_cast<std::uint32_t>(a);
+    }
+
+    auto siftDown(std::size_t position) noexcept
+    {
+        for (;;)
+        {
+            auto smallest = position;
+            for (auto child = 2 * position + 1; child <= 2 * position + 2 && child < _entries.size(); child++)
+            {
+                if (_entries[child].count < _entries[smallest].count)
+                {
+                    smallest = child;
+                }
+            }
+            if (smallest == position)
+            {
+                return;
+            }
+            swap(position, smallest);
+            position = smallest;
+        }
+    }
+
+    // Rows a station without an entry may have had: at most the smallest count once the summary is full
+    inline auto floor() const noexcept
+    {
+        return _entries.size() < _capacity ? std::uint64_t{0} : _entries.front().count;
+    }
+
+    inline auto lookup(std::string_view name, std::uint64_t hash) const noexcept -> const Entry *
+    {
+        auto slot = find(name, hash);
+        return _index[slot] != empty ? &_entries[_index[slot]] : nullptr;
+    }
+
+    auto siftUp(std::size_t position) noexcept
+    {
+        while (position > 0 && _entries[(position - 1) / 2].count > _entries[position].count)
+        {
+            swap(position, (position - 1) / 2);
+            position = (position - 1) / 2;
+        }
+    }
+
+public:
+    explicit SpaceSaving(std::size_t capacity)
+        : _index(std::size_t{2} << (64 - __builtin_clzll(std::max<std::size_t>(capacity, 2) - 1)), empty),
+          _capacity{std::max<std::size_t>(capacity, 1)},
+          _mask{_index.size() - 1}
+    {
+        _entries.reserve(_capacity);
+    }
+
+    auto offer(std::string_view name, std::uint64_t hash, std::uint64_t rows = 1, std::uint64_t error = 0)
+    {
+        name = name.substr(0, maxStationLength);
+        auto slot = find(name, hash);
+        if (_index[slot] != empty)
+        {
+            auto position = _index[slot];
+            _entries[position].count += rows;
+            _entries[position].error += error;
+            siftDown(position);
+            return;
+        }
+
+        auto position = _entries.size();
+        auto inherited = std::uint64_t{0};
+        if (position < _capacity)
+        {
+            _entries.emplace_back();
+        }
+        else
+        {
+            // Take over the slot of the station with the fewest rows
+            position = 0;
+            inherited = _entries[0].count;
+            erase(slotOf(0));
+            slot = find(name, hash);
+        }
+
+        auto &entry = _entries[position];
+        entry.hash = hash;
+        entry.count = inherited + rows;
+        entry.error = inherited + error;
+        entry.length = static_cast<std::uint32_t>(name.size());
+        std::memcpy(entry.name, name.data(), name.size());
+        _index[slot] = static_cast<std::uint32_t>(position);
+
+        if (position == 0)
+        {
+            siftDown(0);
+        }
+        else
+        {
+            siftUp(position);
+        }
+    }
+
+    // Mergeable-summaries merge (Agarwal et al.): a station missing from one summary is credited with that
+    // summary's floor, both as rows and as error, the counts of shared stations add up, and the `capacity`
+    // largest counts are kept. Offering the other entries one by one instead would credit nothing for
+    // the missing rows and could evict a heavy station partway through.
+    auto merge(const SpaceSaving &other)
+    {
+        auto floor = this->floor();
+        auto otherFloor = other.floor();
+
+        auto merged = std::vector<Entry>{};
+        merged.reserve(_entries.size() + other._entries.size());
+        for (const auto &entry : _entries)
+        {
+            merged.push_back(entry);
+            auto match = other.lookup(entry.key(), entry.hash);
+            merged.back().count += match != nullptr ? match->count : otherFloor;
+            merged.back().error += match != nullptr ? match->error : otherFloor;
+        }
+        for (const auto &entry : other._entries)
+        {
+            if (lookup(entry.key(), entry.hash) == nullptr)
+            {
+                merged.push_back(entry);
+                merged.back().count += floor;
+                merged.back().error += floor;
+            }
+        }
+
+        auto moreRows = [](const Entry &a, const Entry &b)
+        {
+            return a.count > b.count;
+        };
+        if (merged.size() > _capacity)
+        {
+            std::nth_element(merged.begin(), merged.begin() + static_cast<std::ptrdiff_t>(_capacity), merged.end(), moreRows);
+            merged.resize(_capacity);
+        }
+
+        // Rebuild the heap, the fewest rows first, and the index over it
+        std::make_heap(merged.begin(), merged.end(), moreRows);
+        _entries = std::move(merged);
+        std::fill(_index.begin(), _index.end(), empty);
+        for (auto position = std::size_t{0}; position < _entries.size(); position++)
+        {
+            _index[find(_entries[position].key(), _entries[position].hash)] = static_cast<std::uint32_t>(position);
+        }
+    }
+
+    inline auto entries() const noexcept -> const std::vector<Entry> &
+    {
+        return _entries;
+    }
+};
+
+// Measurements the first pass of --top has no use for, the sketches only count rows
+struct DiscardedMeasurements
+{
+    inline auto record(std::int32_t) noexcept
+    {
+    }
+};
+
+// Parser map of the first pass of --top: every row feeds the sketches, its measurement is dropped
+template <typename Hash>
+class StationSketch
+{
+    SpaceSaving _heavy;
+    CountMin _counts;
+    HyperLogLog _distinct;
+    DiscardedMeasurements _discarded;
+
+public:
+    using hasher = Hash;
+    using mapped_type = DiscardedMeasurements;
+
+    explicit StationSketch(std::size_t capacity) : _heavy{capacity}
+    {
+    }
+
+    inline auto get(std::string_view name, std::uint64_t hash) -> DiscardedMeasurements &
+    {
+        hash = spread(hash);
+        _distinct.add(hash);
+        _counts.add(hash);
+        _heavy.offer(name, hash);
+        return _discarded;
+    }
+
+    auto merge(const StationSketch &other)
+    {
+        _heavy.merge(other._heavy);
+        _counts.merge(other._counts);
+        _distinct.merge(other._distinct);
+    }
+
+    // The stations most likely to have the most rows. Both sketches overcount, so the smaller of the two
+    // bounds ranks the candidates. The space-saving counts add up to at most the rows, so fewer than `count`
+    // entries count more than rows / count: every station with more than that many rows is among the
+    // candidates, as long as the summary keeps more than `count` stations.
+    auto candidates(std::size_t count) const
+    {
+        auto ranked = std::vector<std::pair<std::uint64_t, std::string_view>>{};
+        for (const auto &entry : _heavy.entries())
+        {
+            ranked.emplace_back(std::min(entry.count, _counts.estimate(entry.hash)), entry.key());
+        }
+
+        auto end = ranked.begin() + static_cast<std::ptrdiff_t>(std::min(count, ranked.size()));
+        std::partial_sort(ranked.begin(), end, ranked.end(), [](const auto &a, const auto &b)
+                          { return a.first > b.first; });
+        ranked.erase(end, ranked.end());
+        return ranked;
+    }
+
+    inline auto distinct() const noexcept
+    {
+        return _distinct.estimate();
+    }
+};
+
+// Parser map of the second pass of --top: exact measurements of a fixed set of candidate stations, all
+// other rows go to a single tail aggregate. Its size depends on the candidates only.
+template <typename Hash, typename Measurements>
+class CandidateTable
+{
+    StationTable<Hash, Measurements> _candidates;
+    Measurements _tail;
+
+public:
+    using hasher = Hash;
+    using mapped_type = Measurements;
+
+    template <typename Names>
+    explicit CandidateTable(const Names &names) : _candidates{2 * std::max<std::size_t>(names.size(), 1)}
+    {
+        for (const auto &name : names)
+        {
+            _candidates[name];
+        }
+    }
+
+    inline auto get(std::string_view name, std::uint64_t hash) -> Measurements &
+    {
+        auto measurements = _candidates.find(name, hash);
+        return measurements != nullptr ? *measurements : _tail;
+    }
+
+    auto merge(const CandidateTable &other)
+    {
+        _candidates.merge(other._candidates);
+        _tail.merge(other._tail);
+    }
+
+    inline auto candidates() const noexcept -> const StationTable<Hash, Measurements> &
+    {
+        return _candidates;
+    }
+
+    inline auto tail() const noexcept -> const Measurements &
+    {
+        return _tail;
+    }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+// Hashes arbitrary station names word at a time: the first 16 bytes, masked to the name length, are mixed
+// with the length, and names longer than 16 bytes fold in their remaining words too. The parser computes
+// it during the scan from the line start with unaligned loads whenever 16 bytes are readable.
+// Everything is constexpr so that the perfect hash below can be generated from the same function.
+struct WordHash
+{
+    static constexpr auto k0 = std::uint64_t{0xa0761d6478bd642f};
+    static constexpr auto k1 = std::uint64_t{0xe7037ed1a0b428db};
+
+    static constexpr auto mix(std::uint64_t a, std::uint64_t b) noexcept -> std::uint64_t
+    {
+        auto product = static_cast<unsigned __int128>(a) * b;
+        return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+    }
+
+    // Little-endian load written byte by byte so it is usable in constant expressions,
+    // the compiler merges it into a single unaligned load
+    static constexpr auto load(const char *p) noexcept -> std::uint64_t
+    {
+        auto word = std::uint64_t{0};
+        for (auto i = 0; i < 8; i++)
+        {
+            word |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(p[i])) << (i * 8);
+        }
+        return word;
+    }
+
+    // Hashes the name [p, p + len) reading no byte at or past end
+    static constexpr auto hash(const char *p, std::size_t len, const char *end) noexcept -> std::uint64_t
+    {
+        std::uint64_t a = 0, b = 0;
+        if (end - p >= 16)
+        {
+            a = load(p);
+            b = load(p + 8);
+        }
+        else
+        {
+            char buffer[16] = {};
+            for (auto i = 0; i < end - p; i++)
+            {
+                buffer[i] = p[i];
+            }
+            a = load(buffer);
+            b = load(buffer + 8);
+        }
+
+        // Keep only the bytes of the name
+        a &= len >= 8 ? ~std::uint64_t{0} : (std::uint64_t{1} << (len * 8)) - 1;
+        b &= len >= 16 ? ~std::uint64_t{0} : len <= 8 ? 0 : (std::uint64_t{1} << ((len - 8) * 8)) - 1;
+
+        auto hash = mix(a ^ k0, b ^ k1 ^ len);
+        if (__builtin_expect(len > 16, 0))
+        {
+            for (auto i = std::size_t{16}; i + 8 < len; i += 8)
+            {
+                hash = mix(hash ^ k0, load(p + i) ^ k1);
+            }
+            hash = mix(hash ^ k0, load(p + len - 8) ^ k1);
+        }
+
+        return hash;
+    }
+
+    constexpr std::size_t operator()(std::string_view str) const noexcept
+    {
+        return hash(str.data(), str.length(), str.data() + str.length());
+    }
+};
+
+// Maps a 64-bit hash onto [0, n) with a multiply instead of a division
+constexpr auto reduce(std::uint64_t hash, std::size_t n) noexcept -> std::size_t
+{
+    return static_cast<std::size_t>((static_cast<unsigned __int128>(hash) * n) >> 64);
+}
+
+// Minimal perfect hash ("hash and displace") over a fixed set of N names. The WordHash of a name
+// selects a bucket, and the bucket's displacement reseeds the hash into a slot of [0, N).
+template <std::size_t N>
+struct PerfectHash
+{
+    static constexpr auto bucketCount = N / 4 + 1;
+
+    std::array<std::uint32_t, bucketCount> displacements{};
+
+    constexpr auto index(std::uint64_t hash) const noexcept -> std::size_t
+    {
+        auto displacement = displacements[reduce(hash, bucketCount)];
+        return reduce(WordHash::mix(hash ^ displacement, WordHash::k1), N);
+    }
+};
+
+// Searches the displacements at compile time, largest buckets first while the table is still empty.
+// Fails to compile (throw in a constant expression) if the names contain duplicates.
+template <std::size_t N>
+constexpr auto makePerfectHash(const std::array<std::string_view, N> &names) -> PerfectHash<N>
+{
+    constexpr auto maxBucketSize = std::size_t{16};
+    constexpr auto maxDisplacement = std::uint32_t{1} << 16;
+
+    auto perfectHash = PerfectHash<N>{};
+    auto hashes = std::array<std::uint64_t, N>{};
+    auto buckets = std::array<std::size_t, N>{};
+    auto bucketSizes = std::array<std::size_t, PerfectHash<N>::bucketCount>{};
+    auto taken = std::array<bool, N>{};
+
+    for (auto i = std::size_t{0}; i < N; i++)
+    {
+        hashes[i] = WordHash{}(names[i]);
+        buckets[i] = reduce(hashes[i], PerfectHash<N>::bucketCount);
+        if (++bucketSizes[buckets[i]] > maxBucketSize)
+        {
+            throw std::logic_error{"PerfectHash bucket overflow"};
+        }
+    }
+
+    for (auto size = maxBucketSize; size > 0; size--)
+    {
+        for (auto bucket = std::size_t{0}; bucket < PerfectHash<N>::bucketCount; bucket++)
+        {
+            if (bucketSizes[bucket] != size)
+            {
+                continue;
+            }
+
+            auto members = std::array<std::uint64_t, maxBucketSize>{};
+            auto count = std::size_t{0};
+            for (auto i = std::size_t{0}; i < N; i++)
+            {
+                if (buckets[i] == bucket)
+                {
+                    members[count++] = hashes[i];
+                }
+            }
+
+            // Find the first displacement that sends every member to a distinct free slot
+            auto displacement = std::uint32_t{0};
+            for (;; displacement++)
+            {
+                if (displacement == maxDisplacement)
+                {
+                    throw std::logic_error{"PerfectHash has no displacement for a bucket"};
+                }
+
+                auto slots = std::array<std::size_t, maxBucketSize>{};
+                auto fits = true;
+                for (auto j = std::size_t{0}; fits && j < count; j++)
+                {
+                    slots[j] = reduce(WordHash::mix(members[j] ^ displacement, WordHash::k1), N);
+                    fits = !taken[slots[j]];
+                    for (auto k = std::size_t{0}; fits && k < j; k++)
+                    {
+                        fits = slots[k] != slots[j];
+                    }
+                }
+
+                if (fits)
+                {
+                    for (auto j = std::size_t{0}; j < count; j++)
+                    {
+                        taken[slots[j]] = true;
+                    }
+                    break;
+                }
+            }
+
+            perfectHash.displacements[bucket] = displacement;
+        }
+    }
+
+    return perfectHash;
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "measurements.hpp"
+#include "station_hash.hpp"
+#include "stations.hpp"
+
+// Station names are at most 100 bytes of UTF-8 according to the challenge rules
+static constexpr auto maxStationLength = std::size_t{100};
+
+// Lookup cost of a filled table, derived from where its entries ended up rather than counted during the scan
+struct ProbeStats
+{
+    std::size_t stations = 0;
+    std::size_t displaced = 0;  // stations that collided with their home slot
+    std::size_t maxProbes = 0;  // slots visited by the longest lookup
+    std::uint64_t rows = 0;
+    std::uint64_t probes = 0;   // slots visited by the lookups of all rows
+
+    auto add(const ProbeStats &other) noexcept
+    {
+        stations += other.stations;
+        displaced += other.displaced;
+        maxProbes = std::max(maxProbes, other.maxProbes);
+        rows += other.rows;
+        probes += other.probes;
+    }
+};
+
+// Open-addressing (linear probing) table of station names and their measurements.
+// A slot holds the low half of the hash, the name's length and pointer and the measurements, while the
+// names themselves are packed into the table's arena: the slots stay small and dense (two compact slots
+// per cache line), and a new station costs a bump of the arena instead of a heap allocation.
+template <typename Hash, typename Measurements>
+class StationTable
+{
+public:
+    using hasher = Hash;
+    using mapped_type = Measurements;
+
+private:
+    // 32-byte aligned when it fits, so that a compact slot never straddles two cache lines
+    struct alignas(sizeof(Measurements) <= 16 ? 32 : std::max(alignof(const char *), alignof(Measurements))) Entry
+    {
+        std::uint32_t hash;   // the low bits pick the home slot, the table never has 2^32 slots
+        std::uint32_t length; // 0 marks an empty slot
+        const char *name;
+        Measurements measurements;
+
+        inline auto key() const noexcept
+        {
+            return std::string_view{name, length};
+        }
+    };
+
+    static_assert(sizeof(Measurements) > 16 || sizeof(Entry) <= 32, "two compact stations must share a cache line");
+
+    std::vector<Entry> _entries;
+    std::size_t _mask;
+    std::size_t _size = 0;
+    Arena _names{std::size_t{16} << 10};
+
+    inline auto slot(std::uint64_t hash, std::string_view name) const noexcept
+    {
+        auto index = static_cast<std::size_t>(hash) & _mask;
+        while (_entries[index].length != 0 &&
+               (_entries[index].hash != static_cast<std::uint32_t>(hash) ||
+                _entries[index].length != name.size() ||
+                std::memcmp(_entries[index].name, name.data(), name.size()) != 0))
+        {
+            index = (index + 1) & _mask;
+        }
+        return index;
+    }
+
+    auto grow()
+    {
+        auto entries = std::vector<Entry>(_entries.size() * 2);
+        std::swap(entries, _entries);
+        _mask = _entries.size() - 1;
+
+        for (auto &entry : entries)
+        {
+            if (entry.length != 0)
+            {
+                auto index = static_cast<std::size_t>(entry.hash) & _mask;
+                while (_entries[index].length != 0)
+                {
+                    index = (index + 1) & _mask;
+                }
+                _entries[index] = std::move(entry);
+            }
+        }
+    }
+
+public:
+    // Fits the 10,000 unique stations allowed by the rules below a 0.75 load factor
+    static constexpr auto defaultCapacity = std::size_t{1} << 14;
+
+    class Iterator
+    {
+        const Entry *_current, *_end;
+
+        inline auto skipEmpty() noexcept
+        {
+            while (_current != _end && _current->length == 0)
+            {
+                _current++;
+            }
+        }
+
+    public:
+        Iterator(const Entry *current, const Entry *end) noexcept : _current{current}, _end{end}
+        {
+            skipEmpty();
+        }
+
+        inline auto operator*() const noexcept
+        {
+            return std::pair<std::string_view, const Measurements &>{_current->key(), _current->measurements};
+        }
+
+        inline auto operator++() noexcept -> Iterator &
+        {
+            _current++;
+            skipEmpty();
+            return *this;
+        }
+
+        inline auto operator!=(const Iterator &other) const noexcept
+        {
+            return _current != other._current;
+        }
+    };
+
+    // The capacity is rounded up to a power of two
+    explicit StationTable(std::size_t capacity = defaultCapacity)
+        : _entries(std::max(std::size_t{2}, std::size_t{1} << (64 - __builtin_clzll(std::max(std::size_t{1}, capacity - 1))))),
+          _mask{_entries.size() - 1}
+    {
+    }
+
+    // Finds the measurements of the station, inserting an empty entry for a new station
+    inline auto operator[](std::string_view name) -> Measurements &
+    {
+        name = name.substr(0, maxStationLength);
+        return get(name, static_cast<std::uint64_t>(Hash{}(name)));
+    }
+
+    // Same as operator[] with the hash of the name already computed by the caller
+    inline auto get(std::string_view name, std::uint64_t hash) -> Measurements &
+    {
+        if (__builtin_expect(name.size() > maxStationLength, 0))
+        {
+            return (*this)[name];
+        }
+
+        auto index = slot(hash, name);
+
+        auto &entry = _entries[index];
+        if (entry.length == 0)
+        {
+            if ((_size + 1) * 4 > _entries.size() * 3)
+            {
+                grow();
+                return get(name, hash);
+            }
+
+            entry.hash = static_cast<std::uint32_t>(hash);
+            entry.name = _names.copy(name).data();
+            entry.length = static_cast<std::uint32_t>(name.size());
+            _size++;
+        }
+
+        return entry.measurements;
+    }
+
+    // The measurements of the station, nullptr if it is not in the table
+    inline auto find(std::string_view name, std::uint64_t hash) noexcept -> Measurements *
+    {
+        if (__builtin_expect(name.size() > maxStationLength, 0))
+        {
+            name = name.substr(0, maxStationLength);
+            hash = static_cast<std::uint64_t>(Hash{}(name));
+        }
+
+        auto &entry = _entries[slot(hash, name)];
+        return entry.length != 0 ? &entry.measurements : nullptr;
+    }
+
+    // Adds every station of other to this table, reusing the cached hashes
+    auto merge(const StationTable &other)
+    {
+        for (const auto &entry : other._entries)
+        {
+            if (entry.length != 0)
+            {
+                get(entry.key(), entry.hash).merge(entry.measurements);
+            }
+        }
+    }
+
+    auto at(std::string_view name) const -> const Measurements &
+    {
+        name = name.substr(0, maxStationLength);
+        const auto &entry = _entries[slot(static_cast<std::uint64_t>(Hash{}(name)), name)];
+        if (entry.length == 0)
+        {
+            throw std::out_of_range{"StationTable::at"};
+        }
+        return entry.measurements;
+    }
+
+    constexpr auto size() const noexcept
+    {
+        return _size;
+    }
+
+    // A lookup walks from the home slot of the hash to the entry, every row of the station repeats it
+    auto probeStats() const noexcept
+    {
+        auto stats = ProbeStats{};
+        for (auto index = std::size_t{0}; index < _entries.size(); index++)
+        {
+            const auto &entry = _entries[index];
+            if (entry.length != 0)
+            {
+                auto probes = ((index - static_cast<std::size_t>(entry.hash)) & _mask) + 1;
+                stats.stations++;
+                stats.displaced += probes > 1;
+                stats.maxProbes = std::max(stats.maxProbes, probes);
+                stats.rows += entry.measurements.count();
+                stats.probes += entry.measurements.count() * probes;
+            }
+        }
+        return stats;
+    }
+
+    inline auto begin() const noexcept
+    {
+        return Iterator{_entries.data(), _entries.data() + _entries.size()};
+    }
+
+    inline auto end() const noexcept
+    {
+        return Iterator{_entries.data() + _entries.size(), _entries.data() + _entries.size()};
+    }
+};
+
+static constexpr auto knownStationCount = std::size(knownStations);
+
+static constexpr auto knownStationHash = makePerfectHash([]
+{
+    auto names = std::array<std::string_view, knownStationCount>{};
+    for (auto i = std::size_t{0}; i < knownStationCount; i++)
+    {
+        names[i] = knownStations[i].name;
+    }
+    return names;
+}());
+
+// Catalogue station names in the order of their perfect hash slots
+static constexpr auto knownStationSlots = []
+{
+    auto slots = std::array<std::string_view, knownStationCount>{};
+    for (const auto &station : knownStations)
+    {
+        slots[knownStationHash.index(WordHash{}(station.name))] = station.name;
+    }
+    return slots;
+}();
+
+static_assert([]
+{
+    for (const auto &station : knownStations)
+    {
+        if (knownStationSlots[knownStationHash.index(WordHash{}(station.name))] != station.name)
+        {
+            return false;
+        }
+    }
+    return true;
+}(), "the perfect hash must give every catalogue station its own slot");
+
+// Measurements of the catalogue stations in a dense array indexed by their perfect hash, so a known
+// station costs one hash, one name compare and no probing. Other names go to a regular StationTable.
+template <typename Measurements>
+class KnownStationTable
+{
+    std::array<Measurements, knownStationCount> _known{};
+    StationTable<WordHash, Measurements> _unknown{64};
+
+public:
+    using hasher = WordHash;
+    using mapped_type = Measurements;
+
+    class Iterator
+    {
+        const KnownStationTable *_table;
+        std::size_t _index;
+        typename StationTable<WordHash, Measurements>::Iterator _unknown;
+
+        inline auto skipEmpty() noexcept
+        {
+            while (_index < knownStationCount && _table->_known[_index].count() == 0)
+            {
+                _index++;
+            }
+        }
+
+    public:
+        Iterator(const KnownStationTable *table, std::size_t index, typename StationTable<WordHash, Measurements>::Iterator unknown) noexcept
+            : _table{table}, _index{index}, _unknown{unknown}
+        {
+            skipEmpty();
+        }
+
+        inline auto operator*() const noexcept
+        {
+            if (_index < knownStationCount)
+            {
+                return std::pair<std::string_view, const Measurements &>{knownStationSlots[_index], _table->_known[_index]};
+            }
+            return *_unknown;
+        }
+
+        inline auto operator++() noexcept -> Iterator &
+        {
+            if (_index < knownStationCount)
+            {
+                _index++;
+                skipEmpty();
+            }
+            else
+            {
+                ++_unknown;
+            }
+            return *this;
+        }
+
+        inline auto operator!=(const Iterator &other) const noexcept
+        {
+            return _index != other._index || _unknown != other._unknown;
+        }
+    };
+
+    inline auto operator[](std::string_view name) -> Measurements &
+    {
+        return get(name, WordHash{}(name));
+    }
+
+    inline auto get(std::string_view name, std::uint64_t hash) -> Measurements &
+    {
+        auto index = knownStationHash.index(hash);
+        if (knownStationSlots[index] == name)
+        {
+            return _known[index];
+        }
+        return _unknown.get(name, hash);
+    }
+
+    auto merge(const KnownStationTable &other)
+    {
+        for (auto i = std::size_t{0}; i < knownStationCount; i++)
+        {
+            _known[i].merge(other._known[i]);
+        }
+        _unknown.merge(other._unknown);
+    }
+
+    auto at(std::string_view name) const -> const Measurements &
+    {
+        auto index = knownStationHash.index(WordHash{}(name));
+        if (knownStationSlots[index] == name && _known[index].count() != 0)
+        {
+            return _known[index];
+        }
+        return _unknown.at(name);
+    }
+
+    // Catalogue stations always take a single probe, the others add the probes of the fallback table
+    auto probeStats() const noexcept
+    {
+        auto stats = _unknown.probeStats();
+        for (const auto &measurements : _known)
+        {
+            if (measurements.count() != 0)
+            {
+                stats.stations++;
+                stats.maxProbes = std::max(stats.maxProbes, std::size_t{1});
+                stats.rows += measurements.count();
+                stats.probes += measurements.count();
+            }
+        }
+        return stats;
+    }
+
+    auto size() const noexcept
+    {
+        auto size = _unknown.size();
+        for (const auto &measurements : _known)
+        {
+            size += measurements.count() != 0;
+        }
+        return size;
+    }
+
+    inline auto begin() const noexcept
+    {
+        return Iterator{this, 0, _unknown.begin()};
+    }
+
+    inline auto end() const noexcept
+    {
+        return Iterator{this, knownStationCount, _unknown.end()};
+    }
+};
+
+#ifdef ONEBRC_PERFECT_HASH
+template <typename Measurements>
+using MapType = KnownStationTable<Measurements>;
+#else
+template <typename Measurements>
+using MapType = StationTable<WordHash, Measurements>;
+#endif
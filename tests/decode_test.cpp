@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "parser.hpp"
+
+// The state-machine parser decodeMeasurement replaced: skips the '.' and accumulates the digits
+static auto parseMeasurement(const char *first, const char *last) noexcept
+{
+    auto negative = *first == '-';
+    auto measurement = std::int32_t{0};
+
+    for (first += negative; first != last; first++)
+    {
+        if (*first != '.')
+        {
+            measurement = measurement * 10 + static_cast<std::int32_t>(*first - '0');
+        }
+    }
+
+    return negative ? -measurement : measurement;
+}
+
+// Decodes every measurement from -99.9 to 99.9 and -0.0, followed by the rest of a line and by the end of
+// the input, and compares it with the state-machine parser
+int main()
+{
+    auto failures = 0;
+    auto check = [&](const std::string &text, const char *suffix)
+    {
+        auto line = text + suffix;
+        auto first = line.data();
+        auto end = first + line.size();
+        auto expected = parseMeasurement(first, first + text.size());
+        auto decoded = decodeMeasurement(first, end);
+        if (decoded != expected)
+        {
+            std::fprintf(stderr, "%s followed by \"%s\": decoded %d, expected %d\n", text.c_str(), suffix, decoded, expected);
+            failures++;
+        }
+    };
+
+    char text[8];
+    for (auto tenths = -999; tenths <= 999; tenths++)
+    {
+        auto magnitude = tenths < 0 ? -tenths : tenths;
+        std::snprintf(text, sizeof(text), "%s%d.%d", tenths < 0 ? "-" : "", magnitude / 10, magnitude % 10);
+        for (auto suffix : {"", "\n", "\nStation;12.3\n", "\n\xff\xff\xff\xff\xff\xff\xff"})
+        {
+            check(text, suffix);
+        }
+    }
+    for (auto suffix : {"", "\n", "\nStation;12.3\n"})
+    {
+        check("-0.0", suffix);
+    }
+
+    if (failures != 0)
+    {
+        std::fprintf(stderr, "%d measurements decoded wrongly\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sketches.hpp"
+#include "station_hash.hpp"
+
+// Feeds skewed random streams to per-thread space-saving summaries, merges them pairwise like the
+// threads of --top do, and checks the space-saving bounds and the candidate guarantee of --top on the
+// merged result against the exact counts
+int main()
+{
+    auto random = std::mt19937_64{42};
+    auto failures = 0;
+    auto fail = [&](const char *what, int trial, const std::string &name)
+    {
+        if (failures++ < 10)
+        {
+            std::fprintf(stderr, "trial %d, %s: %s\n", trial, name.c_str(), what);
+        }
+    };
+
+    for (auto trial = 0; trial < 500; trial++)
+    {
+        auto capacity = std::size_t{4} << (trial % 4);
+        auto threads = 2 + trial % 7;
+        auto top = capacity / 4;
+        auto stationCount = capacity * (2 + trial % 5);
+        auto rowCount = 20 + random() % (capacity * 50);
+
+        // Zipf-like weights, heavier skew in some trials
+        auto skew = 0.5 + static_cast<double>(trial % 3) * 0.5;
+        auto weights = std::vector<double>(stationCount);
+        for (auto i = std::size_t{0}; i < stationCount; i++)
+        {
+            weights[i] = 1.0 / std::pow(static_cast<double>(i + 1), skew);
+        }
+        auto draw = std::discrete_distribution<std::size_t>{weights.begin(), weights.end()};
+
+        auto names = std::vector<std::string>(stationCount);
+        for (auto i = std::size_t{0}; i < stationCount; i++)
+        {
+            names[i] = "S" + std::to_string(i);
+        }
+
+        // Each thread takes a contiguous run of rows, like a segment of the input
+        auto summaries = std::vector<SpaceSaving>(static_cast<std::size_t>(threads), SpaceSaving{capacity});
+        auto sketches = std::vector<StationSketch<WordHash>>(static_cast<std::size_t>(threads), StationSketch<WordHash>{capacity});
+        auto exact = std::vector<std::uint64_t>(stationCount);
+        for (auto row = std::uint64_t{0}; row < rowCount; row++)
+        {
+            auto station = draw(random);
+            auto thread = static_cast<std::size_t>(row * static_cast<std::uint64_t>(threads) / rowCount);
+            auto hash = static_cast<std::uint64_t>(WordHash{}(names[station]));
+            summaries[thread].offer(names[station], spread(hash));
+            sketches[thread].get(names[station], hash);
+            exact[station]++;
+        }
+
+        for (auto stride = std::size_t{1}; stride < summaries.size(); stride *= 2)
+        {
+            for (auto i = std::size_t{0}; i + stride < summaries.size(); i += 2 * stride)
+            {
+                summaries[i].merge(summaries[i + stride]);
+                sketches[i].merge(sketches[i + stride]);
+            }
+        }
+
+        const auto &entries = summaries.front().entries();
+        auto total = std::uint64_t{0};
+        auto floor = entries.size() < capacity ? std::uint64_t{0} : entries.front().count;
+        auto kept = std::vector<bool>(stationCount);
+        for (const auto &entry : entries)
+        {
+            auto station = std::stoul(std::string{entry.key().substr(1)});
+            kept[station] = true;
+            total += entry.count;
+            if (entry.count < exact[station] || entry.count - entry.error > exact[station])
+            {
+                fail("count does not bound the rows", trial, names[station]);
+            }
+            floor = std::min(floor, entry.count);
+        }
+        if (total > rowCount)
+        {
+            fail("counts add up to more than the rows", trial, "all");
+        }
+
+        for (auto station = std::size_t{0}; station < stationCount; station++)
+        {
+            if (!kept[station] && exact[station] > floor)
+            {
+                fail("station with more rows than the smallest count was dropped", trial, names[station]);
+            }
+            if (!kept[station] && exact[station] * capacity > rowCount)
+            {
+                fail("station above rows / capacity was dropped", trial, names[station]);
+            }
+        }
+
+        // --top=k keeps 4k stations and takes 2k candidates, every station above rows / 2k must be one
+        auto candidates = sketches.front().candidates(2 * top);
+        for (auto station = std::size_t{0}; station < stationCount; station++)
+        {
+            if (exact[station] * 2 * top <= rowCount)
+            {
+                continue;
+            }
+
+            auto found = false;
+            for (const auto &candidate : candidates)
+            {
+                found = found || candidate.second == names[station];
+            }
+            if (!found)
+            {
+                fail("station above rows / 2k is not a candidate", trial, names[station]);
+            }
+        }
+    }
+
+    if (failures != 0)
+    {
+        std::fprintf(stderr, "%d failed checks\n", failures);
+        return 1;
+    }
+    return 0;
+}
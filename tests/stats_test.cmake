@@ -0,0 +1,44 @@
+# --stats after a scan into the shared table: every thread reports the rows it parsed, the probe line
+# describes the shared table, and the result matches the per-thread tables. Build with
+# -DONEBRC_SANITIZE=address to have out-of-bounds reads of the report fail the test.
+#
+#   cmake -DCREATE=<create_measurements> -DAVERAGE=<calculate_average> -DDIR=<scratch> -P stats_test.cmake
+
+set(rows 200000)
+file(MAKE_DIRECTORY ${DIR})
+
+execute_process(COMMAND ${CREATE} --seed=7 --stations=5000 ${rows} WORKING_DIRECTORY ${DIR} RESULT_VARIABLE status OUTPUT_QUIET)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "create_measurements failed: ${status}")
+endif()
+
+execute_process(COMMAND ${AVERAGE} --stats --table=shared --threads=4 --segment-size=1 measurements.txt
+                WORKING_DIRECTORY ${DIR} RESULT_VARIABLE status OUTPUT_VARIABLE shared ERROR_VARIABLE report)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "calculate_average --stats --table=shared failed: ${status}\n${report}")
+endif()
+
+execute_process(COMMAND ${AVERAGE} --table=per-thread --threads=4 measurements.txt
+                WORKING_DIRECTORY ${DIR} RESULT_VARIABLE status OUTPUT_VARIABLE perThread)
+if(NOT status EQUAL 0 OR NOT shared STREQUAL perThread)
+    message(FATAL_ERROR "the shared and per-thread tables disagree")
+endif()
+
+string(REGEX MATCHALL "thread [0-9]+: [0-9]+ segments, [0-9]+ bytes, [0-9]+ rows" threads "${report}")
+list(LENGTH threads count)
+if(NOT count EQUAL 4)
+    message(FATAL_ERROR "expected 4 thread lines:\n${report}")
+endif()
+
+set(total 0)
+foreach(line IN LISTS threads)
+    string(REGEX REPLACE ".* ([0-9]+) rows" "\\1" threadRows "${line}")
+    math(EXPR total "${total} + ${threadRows}")
+endforeach()
+if(NOT total EQUAL rows)
+    message(FATAL_ERROR "the threads report ${total} rows instead of ${rows}:\n${report}")
+endif()
+
+if(NOT report MATCHES "probes: [0-9]+ shared stations")
+    message(FATAL_ERROR "no probe line for the shared table:\n${report}")
+endif()
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Minimal io_uring on the raw kernel interface, just enough for reads into fixed buffers: one thread
+// submits and reaps, no SQPOLL. The constructor throws std::system_error when the kernel refuses a
+// ring (old kernel, seccomp, io_uring_disabled), so callers can fall back to another reader.
+class IoUring
+{
+    int _fd = -1;
+    io_uring_params _params{};
+    void *_sqRing = MAP_FAILED;
+    void *_cqRing = MAP_FAILED;
+    std::size_t _sqRingSize = 0;
+    std::size_t _cqRingSize = 0;
+    io_uring_sqe *_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    std::size_t _sqesSize = 0;
+
+    unsigned *_sqHead, *_sqTail, *_sqMask, *_sqArray;
+    unsigned *_cqHead, *_cqTail, *_cqMask;
+    io_uring_cqe *_cqes;
+    unsigned _unsubmitted = 0;
+    bool _fixedBuffers = false;
+
+    template <typename T>
+    auto field(void *ring, std::uint32_t offset) noexcept
+    {
+        return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+    }
+
+    auto release() noexcept
+    {
+        if (_sqes != MAP_FAILED)
+        {
+            ::munmap(_sqes, _sqesSize);
+        }
+        if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+        {
+            ::munmap(_cqRing, _cqRingSize);
+        }
+        if (_sqRing != MAP_FAILED)
+        {
+            ::munmap(_sqRing, _sqRingSize);
+        }
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+    }
+
+public:
+    explicit IoUring(unsigned entries)
+    {
+        _fd = static_cast<int>(::syscall(SYS_io_uring_setup, entries, &_params));
+        if (_fd < 0)
+        {
+            throw std::system_error{errno, std::generic_category(), "io_uring_setup"};
+        }
+
+        // Both rings share one mapping on kernels with IORING_FEAT_SINGLE_MMAP
+        _sqRingSize = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+        _cqRingSize = _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe);
+        auto single = (_params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single)
+        {
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+        }
+
+        _sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        _cqRing = single ? _sqRing : ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        _sqesSize = _params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe *>(::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+        if (_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || _sqes == MAP_FAILED)
+        {
+            auto error = errno;
+            release();
+            throw std::system_error{error, std::generic_category(), "io_uring mmap"};
+        }
+
+        _sqHead = field<unsigned>(_sqRing, _params.sq_off.head);
+        _sqTail = field<unsigned>(_sqRing, _params.sq_off.tail);
+        _sqMask = field<unsigned>(_sqRing, _params.sq_off.ring_mask);
+        _sqArray = field<unsigned>(_sqRing, _params.sq_off.array);
+        _cqHead = field<unsigned>(_cqRing, _params.cq_off.head);
+        _cqTail = field<unsigned>(_cqRing, _params.cq_off.tail);
+        _cqMask = field<unsigned>(_cqRing, _params.cq_off.ring_mask);
+        _cqes = field<io_uring_cqe>(_cqRing, _params.cq_off.cqes);
+    }
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    ~IoUring()
+    {
+        release();
+    }
+
+    // Pins the buffers for IORING_OP_READ_FIXED, returns false if the memlock limit does not allow it
+    auto registerBuffers(const iovec *buffers, unsigned count) noexcept
+    {
+        _fixedBuffers = ::syscall(SYS_io_uring_register, _fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+        return _fixedBuffers;
+    }
+
+    // Queues a read of length bytes at offset into buffer (the registered buffer index when buffers are
+    // registered), returns false if the submission queue is full
+    auto read(int fd, unsigned index, void *buffer, std::uint32_t length, std::uint64_t offset, std::uint64_t userData) noexcept
+    {
+        auto tail = *_sqTail;
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) == _params.sq_entries)
+        {
+            return false;
+        }
+
+        auto slot = tail & *_sqMask;
+        auto &sqe = _sqes[slot];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = _fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.buf_index = static_cast<std::uint16_t>(_fixedBuffers ? index : 0);
+        sqe.user_data = userData;
+
+        _sqArray[slot] = slot;
+        __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+        _unsubmitted++;
+        return true;
+    }
+
+    // Submits the queued reads and waits for a completion with its user data and result (bytes or -errno),
+    // returns 0 or the errno of a failed io_uring_enter()
+    auto wait(std::uint64_t &userData, std::int32_t &result) noexcept -> int
+    {
+        for (;;)
+        {
+            auto head = *_cqHead;
+            if (head != __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+            {
+                const auto &cqe = _cqes[head & *_cqMask];
+                userData = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+
+            auto submitted = ::syscall(SYS_io_uring_enter, _fd, _unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno;
+            }
+            _unsubmitted -= static_cast<unsigned>(submitted);
+        }
+    }
+};